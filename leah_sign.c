@@ -6,8 +6,11 @@
 #include <avr/interrupt.h>
 #include <avr/wdt.h>
 #include <avr/eeprom.h>
+#include <avr/pgmspace.h>
+#include <avr/power.h>
+#include <avr/sleep.h>
+#include <util/atomic.h>
 #include <util/delay.h>
-#include <stdlib.h>
 
 /******************************************************************
  * Conrol LED lights for Leah's sign using Attiny85
@@ -32,993 +35,2792 @@ void reset(){
 	while(1){};
 }
 
+/**
+ * Profiling
+ *
+ * Build with PROFILE to time the interrupts and the frames on the chip.
+ * There is no spare timer, but timer0 counts microseconds (one cycle at
+ * 1 MHz, eight at 8 MHz), which is fine enough for code this short. Each
+ * ISR reads TCNT0 at the top of its body and adds the difference at the
+ * bottom, so the prologue and epilogue (~20 cycles) aren't counted, and
+ * the timer0 and ADC times include anything that nested in them. The PB3
+ * interrupts lose ISR_NAKED to make room for the timing.
+ * The PB3 interrupts also keep the worst wait from their timer1 event to
+ * the top of the body (TCNT1 against the edge), in timer1 ticks: 1 us
+ * with the PLL, 8 us with BCM, 64 us otherwise. It includes the ~20
+ * cycle prologue the PROFILE build adds, so compare sequences against
+ * each other rather than against zero.
+ * Frame times are kept per sequence, see the scheduler. A long press
+ * writes everything to profile_ee before resetting, read it back with
+ * avrdude -U eeprom:r:eeprom.hex:i.
+ */
+#ifdef PROFILE
+#define	PROF_T0_OVF	0
+#define	PROF_T1_OVF	1
+#define	PROF_T1_COMPA	2
+#define	PROF_ADC	3
+#define	PROF_NUM_ISR	4
+
+typedef struct {
+	uint32_t count;
+	uint32_t sum_us;
+	uint8_t max_us;
+} prof_isr;
+
+prof_isr prof_isrs[PROF_NUM_ISR];
+
+static inline void prof_isr_add(uint8_t n, uint8_t us){
+	prof_isr *p = &prof_isrs[n];
+	p->count++;
+	p->sum_us += us;
+	if(us > p->max_us) p->max_us = us;
+}
+
+#define	PROF_EDGE_OVF	0
+#define	PROF_EDGE_COMPA	1
+
+uint8_t prof_pb3_late[2];
+
+static inline void prof_edge(uint8_t n, uint8_t ticks){
+	if(ticks > prof_pb3_late[n]) prof_pb3_late[n] = ticks;
+}
+
+#define	PROF_ISR_BEGIN()	uint8_t prof_start = TCNT0
+#define	PROF_ISR_END(n)		prof_isr_add(n, TCNT0 - prof_start)
+#define	PROF_EDGE(n, ticks)	prof_edge(n, ticks)
+#else
+#define	PROF_ISR_BEGIN()
+#define	PROF_ISR_END(n)
+#define	PROF_EDGE(n, ticks)
+#endif
+
 /**
  * Since ATTiny85 unfortunately only has built-in support for PWM output on Pins 3, 5, and 6,
  * emulate Fast PWM on Pin 2 via timer1 interrupts
+ *
+ * Build with TIMER1_PLL to clock timer1 from the 64 MHz PLL. Its PWM then
+ * runs at 64 MHz / 64 / 256 = 3.9 kHz, the same as timer0, instead of
+ * ~61 Hz.
+ *
+ * Build with PB3_BCM to drive the pin with binary code modulation
+ * instead, see below.
+ *
+ * Any delay before an edge interrupt runs shows up as flicker on the
+ * letter, worst at low levels, so the edge interrupts are kept short,
+ * naked where they only test and flip I/O bits (sbis, sbi, cbi: no
+ * registers, no SREG), and the timer0 tick and the ADC let them
+ * in while they run. What is left to wait behind is the EEPROM interrupt
+ * while settings are written (~60 cycles), millis() and the framebuffer
+ * commits with interrupts off, and the other edge. The serial stream
+ * receiver holds everything off for a packet (~1 ms).
+ *
+ * Compare A outranks the overflow, so an overflow held off past the
+ * period's match runs after the compare has already cleared the pin.
+ * Setting the pin then would light it for a whole period, the brightest
+ * flash there is, so the overflow only sets it while the match is still
+ * ahead. No minimum duty could cover the waits instead: make bench sees
+ * edges held off ~60 us by the main loop's cli sections at 1 MHz and
+ * ~1 ms by a stream packet.
+ * Check the listing (avr-objdump -d) after changing a naked ISR, the
+ * compiler doesn't warn if it needs a register after all.
+ */
+#ifdef PROFILE
+#define	PB3_ISR		ISR_BLOCK
+#define	pb3_reti()
+#else
+#define	PB3_ISR		ISR_NAKED
+#define	pb3_reti()	reti()
+#endif
+
+#if defined(PB3_BCM)
+/**
+ * Binary code modulation on PB3
+ *
+ * Each frame (one timer1 period) is split into 8 slots of 1, 2, 4 ... 128
+ * ticks and the pin shows one bit of the duty in each slot. That always
+ * takes 8 interrupts per frame whatever the duty, and no slot ever needs
+ * an edge closer than one tick to another, so the lowest levels work.
+ *
+ * Slot 0 starts at 255, just before the overflow, and latches the next
+ * frame's bit plane. Slot 1 starts at the overflow, slots 2-7 at compare
+ * A matches at 2^k - 2. Slot 7 is one tick longer (129) to fill the
+ * frame. Each compare interrupt sets up the next match, which is at
+ * least 3 ticks after its own (slot 0 skips the overflow's slot), and the
+ * write has to land before it or the match waits a whole frame.
+ *
+ * So timer1 ticks every 64 cpu cycles, 192 for the write against ~50 for
+ * the compare interrupt, which leaves room for a wait behind the EEPROM
+ * interrupt or a cli section in the main loop (make bench counts the
+ * misses; a stream packet still costs a frame). That is 8 us at 8 MHz,
+ * 488 Hz frames (also OC1B's PWM rate), so BCM builds play the
+ * animations at 8 MHz (CLOCK_SEQ), and 64 us at 1 MHz, where the frames
+ * are too slow to look at but still right.
+ *
+ * The frame and slot live in general purpose I/O registers, so the
+ * overflow can be naked and the compare skips the loads and stores.
  */
+#if defined(TIMER1_PLL)
+#define	TIMER1_CS_1MHZ	13	// PCK/4096
+#define	TIMER1_CS_8MHZ	10	// PCK/512
+#else
+#define	TIMER1_CS_1MHZ	7	// clk/64
+#define	TIMER1_CS_8MHZ	7
+#endif
+
+volatile uint8_t bcm_plane = 0;	// duty to show from the next frame
+#define	bcm_frame	GPIOR1	// duty shown this frame
+#define	bcm_bit		GPIOR2	// slot the next compare match starts, 0x01 from timer1_init()
+
+ISR(TIMER1_OVF_vect, PB3_ISR){
+	PROF_ISR_BEGIN();
+	PROF_EDGE(PROF_EDGE_OVF, TCNT1);
+	if(bcm_frame & 0x02){
+		PORTB |= (1 << PB3);
+	}
+	else {
+		PORTB &= ~(1 << PB3);
+	}
+	PROF_ISR_END(PROF_T1_OVF);
+	pb3_reti();
+}
 
-// set pin on overflow
-ISR(TIMER1_OVF_vect){
-	// don't turn on at all for low values of OCR1A to compensate for interrupt latency
-	if(OCR1A > 4){
+ISR(TIMER1_COMPA_vect){
+	PROF_ISR_BEGIN();
+	PROF_EDGE(PROF_EDGE_COMPA, TCNT1 - OCR1A);
+	uint8_t m = bcm_bit;
+	if(m == 0x01) bcm_frame = bcm_plane;
+
+	if(bcm_frame & m){
 		PORTB |= (1 << PB3);
 	}
+	else {
+		PORTB &= ~(1 << PB3);
+	}
+
+	if(m == 0x01){
+		// slot 1 starts at the overflow
+		OCR1A = 2;
+		m = 0x04;
+	}
+	else if(m == 0x80){
+		OCR1A = 255;
+		m = 0x01;
+	}
+	else {
+		OCR1A = (m << 1) - 2;
+		m <<= 1;
+	}
+	bcm_bit = m;
+	PROF_ISR_END(PROF_T1_COMPA);
+}
+
+// set PB3 duty
+static inline void pb3_write(uint8_t duty){
+	bcm_plane = duty;
+}
+
+#else
+#if defined(TIMER1_PLL)
+#define	TIMER1_CS_1MHZ	7	// PCK/64
+#define	TIMER1_CS_8MHZ	7
+
+// ~20 cpu cycles from overflow to the overflow's TCNT1 read, in 1 us
+// timer ticks; a shorter duty is always past by then
+#define	PB3_MIN_DUTY(f_cpu)	((20000000L + (f_cpu) - 1) / (f_cpu))
+#else
+#define	TIMER1_CS_1MHZ	7	// clk/64, ~61 Hz
+#define	TIMER1_CS_8MHZ	10	// clk/512
+
+// timer1 ticks every 64 us at either speed, leave a few for the latency
+#define	PB3_MIN_DUTY(f_cpu)	4
+#endif
+
+// follows the system clock, see clock_set()
+uint8_t pb3_min_duty = PB3_MIN_DUTY(F_CPU);
+
+// set pin on overflow, unless the match went by while it waited; needs
+// registers for the compare so it isn't naked
+ISR(TIMER1_OVF_vect){
+	PROF_ISR_BEGIN();
+	PROF_EDGE(PROF_EDGE_OVF, TCNT1);
+	if(TCNT1 < OCR1A) PORTB |= (1 << PB3);
+	PROF_ISR_END(PROF_T1_OVF);
 }
 
 // clear pin on match
-ISR(TIMER1_COMPA_vect){
+ISR(TIMER1_COMPA_vect, PB3_ISR){
+	PROF_ISR_BEGIN();
+	PROF_EDGE(PROF_EDGE_COMPA, TCNT1 - OCR1A);
 	PORTB &= ~(1 << PB3);
+	PROF_ISR_END(PROF_T1_COMPA);
+	pb3_reti();
 }
 
-// Read analog value (0-1024) from ADC0-3 (PB5, PB2, PB4, PB3)
-// ch must be in range 0..3
-uint16_t adc_read(uint8_t ch){
-  // set MUX values to control which AD channel to sample
-  // clear bottom 3 bits and then assign ch
-  ADMUX = (ADMUX & 0b11111000) | ch;
+// set PB3 duty, too short for the interrupt latency and it stays off
+static inline void pb3_write(uint8_t duty){
+	OCR1A = duty;
+	if(duty > pb3_min_duty){
+		TIMSK |= (1 << TOIE1);
+	}
+	else {
+		TIMSK &= ~(1 << TOIE1);
+	}
+}
+#endif
+
+void timer1_init(){
+#ifdef TIMER1_PLL
+	// start the PLL, let it stabilize and lock, then clock timer1 from it
+	PLLCSR = (1 << PLLE);
+	_delay_us(100);
+	while(!(PLLCSR & (1 << PLOCK)));
+	PLLCSR |= (1 << PCKE);
+#endif
+
+	OCR1C = 255;
+#ifdef PB3_BCM
+	// Configure Timer/Counter-1
+	// compare A only schedules BCM slots, 64 cycle ticks
+	OCR1A = 255;
+	bcm_bit = 0x01;
+	TCCR1 = (TIMER1_CS_1MHZ << CS10);
+#else
+	// Configure Timer/Counter-1
+	// Don't output to 0C1A, clk/64 (PCK/64 with the PLL)
+	TCCR1 = (1 << PWM1A) | (3 << COM1A0) | (TIMER1_CS_1MHZ << CS10);
+#endif
+	// Enable inverted output on OC1B, off until the first latch
+	OCR1B = 255;
+	GTCCR = (1 << PWM1B) | (3 << COM1B0);
+}
 
-  // start single conversion
-  ADCSRA |= (1 << ADSC);
+// start both PWM timers and their interrupts, from power up and standby
+void pwm_init(){
+	// Clear OC0A on Compare Match, set at bottom; OC0B the other way
+	// round, off until the first latch (see the framebuffer)
+	// Configure Timer/Counter-0 for fast PWM
+	OCR0B = 255;
+	TCCR0A = (2 << COM0A0) | (3 << COM0B0) | (3 << WGM00);
+	// Enable fast PWM mode, no prescaling
+	TCCR0B = (0 << WGM02) | (1 << CS00);
 
-  // wait for conversion to complete
-  while(ADCSRA & (1 << ADSC));
+	timer1_init();
+#ifdef TIMER1_PLL
+	// same rate as timer0, start its period half way through timer0's
+	TCNT1 = TCNT0 + 128;
+#endif
 
-  // ADC contains converted value
-  return (ADC);
+	// Enable interrupt on matcha and overflow Timer/Counter-1, overflow t/c-0
+	TIMSK = (1 << OCIE1A) | (1 << TOIE1) | (1 << TOIE0);
+}
+
+/**
+ * Background ADC pipeline
+ *
+ * While something reads the mic samples (the mic and spectrum sequences,
+ * or the modulation with a depth set) mic conversions (ADC1 on PB2) are
+ * auto triggered by the timer0 overflow, so the mic is sampled at a
+ * fixed MIC_SAMPLE_RATE whatever the main loop is doing. Every
+ * ADC_BUTTON_EVERY conversions the ADC complete interrupt slips in a button
+ * conversion (ADC0 on RESET, PB5) right after the mic one, which
+ * finishes well before the next trigger.
+ *
+ * Otherwise the mic runs slow (adc_mic_rate()): auto triggering is off
+ * and the millis tick starts a mic sample every ADC_SLOW_MS, each
+ * followed by the button, so the button and the supply keep the same
+ * timing and standby_listen() still hears the room, for ~1000 ADC
+ * interrupts a second instead of ~4400.
+ *
+ * Every ADC_VCC_EVERY-th of those slots measures the 1.1 V bandgap
+ * against Vcc instead: one reading to let it settle, as the first after
+ * switching to it is off, then ADC_VBG_SAMPLES summed and decimated to
+ * ADC_VBG_BITS. Roughly every 130 ms the mic loses two conversions to
+ * the longer slot. See the supply monitor.
+ *
+ * Conversions come in two modes:
+ *
+ * - ADC_FAST: left adjusted, only ADCH is read (8 bits) and the ADC
+ *   clock is doubled to 250 kHz, ~55 us per conversion, still good for 8
+ *   bits. The button always uses it, and so does the mic for sequences
+ *   that want its raw samples at full swing (the spectrum at 8 MHz).
+ * - ADC_PRECISE: right adjusted, all 10 bits at 125 kHz, ~110 us. The
+ *   bandgap, and the mic for the level detector: two conversions in a
+ *   row are summed into one 11 bit sample over the whole range, so a
+ *   quiet room isn't lost between two counts and a loud one isn't cut
+ *   off, at half the rate and 16 bits a sample. A burst of conversions
+ *   per trigger doesn't fit, four take over 400 us of the 256 between
+ *   triggers and each restart waits for the interrupt.
+ *
+ * The ADC clock follows the system clock, see clock_set(). Sequences
+ * pick the mic's mode with adc_mic_mode(), seq_start() resets it to
+ * ADC_PRECISE.
+ *
+ * Noise reduction sleep would quiet the conversions further but stops
+ * timer0, the PWM and millis with it, so only standby() uses it, where
+ * they are stopped anyway. Its conversions are tagged with ADC_STANDBY
+ * and only leave their reading in adc_standby.
+ *
+ * Mic samples are collected in two blocks: while the ISR fills one, the
+ * main loop processes the other. Results go into buffers with a single
+ * writer, which the main loop reads in O(1) without disabling interrupts.
+ *
+ * The complete interrupt runs with interrupts enabled so it doesn't hold
+ * up the PB3 edges, which lets it nest in itself. A conversion it starts
+ * is done in ~104 us, or ~52 us for ADC_FAST (the button): as little as
+ * 52 cycles at 1 MHz, and a timer0 tick in between can hold up the rest
+ * of the handler past that. So adc_complete() stores all of its state
+ * (mic position, slot count, bandgap sum and count) and only says
+ * whether to start the next one, and the handler sets ADSC after
+ * restoring GIMSK and its profiling. Only the epilogue can overlap the
+ * next interrupt.
+ */
+#define	ADC_CH_BUTTON	0
+#define	ADC_CH_MIC	1
+#define	ADC_CH_VBG	12
+// REFS2 means nothing with Vcc as the reference, so it marks standby
+// conversions at no cost to the others
+#define	ADC_STANDBY	(1 << REFS2)
+
+// sizes must be powers of 2
+#define	ADC_BUTTON_EVERY	8
+#define	ADC_VCC_EVERY		64
+// 4^n samples carry n more bits
+#define	ADC_VBG_SAMPLES		4
+#define	ADC_VBG_BITS		11
+
+#define	ADC_PRECISE	0
+#define	ADC_FAST	1
+
+#define	MIC_SAMPLE_RATE	(1000000L / 256)	// 3.9 kHz, precise samples at half that
+#define	MIC_BLOCK_SIZE	32		// 8 ms
+#define	MIC_PRECISE_SIZE	(MIC_BLOCK_SIZE / 2)
+
+#define	MIC_RATE_SLOW	0
+#define	MIC_RATE_FULL	1
+#define	ADC_SLOW_MS	2		// one button slot, as at the full rate
+
+// latest button reading (one byte so reads can't tear)
+volatile uint8_t adc_button = 255;
+
+// a block is MIC_BLOCK_SIZE fast samples or MIC_PRECISE_SIZE precise ones
+typedef union {
+	uint8_t fast[MIC_BLOCK_SIZE];
+	uint16_t precise[MIC_PRECISE_SIZE];
+} mic_samples;
+
+mic_samples mic_blocks[2];
+uint8_t mic_fill = 0;			// block the ISR is filling
+uint8_t mic_fill_pos = 0;
+volatile uint8_t mic_ready = 0;		// 1 + index of the block for the main loop, or 0
+volatile uint8_t mic_overruns = 0;	// blocks dropped because the main loop was busy
+
+uint8_t adc_mic = ADC_PRECISE;		// the mic's mode
+uint8_t adc_mic_full = MIC_RATE_SLOW;	// the mic's rate
+uint8_t adc_mic_count = 0;		// mic conversions, for the slots
+uint8_t adc_mic_odd = 0;		// adc_mic_sum holds the first of a precise sample
+uint16_t adc_mic_sum;
+uint8_t adc_slow_ms = 0;
+uint8_t adc_ps[2] = { 3, 2 };		// ADPS for each mode at the system clock
+
+uint8_t adc_slot = 0;			// button slots so far
+uint8_t adc_vbg_settling = 0;		// the next bandgap reading is thrown away
+uint8_t adc_vbg_count = 0;
+uint16_t adc_vbg_sum = 0;
+volatile uint16_t adc_vbg = 0;		// latest bandgap reading, ADC_VBG_BITS
+volatile uint8_t adc_vbg_ready = 0;	// set with each new one
+volatile uint8_t adc_standby;		// latest standby reading
+volatile uint8_t adc_standby_ready = 0;
+
+// set up the next conversion of the pipeline
+static inline void adc_select(uint8_t channel, uint8_t mode){
+	ADMUX = ((mode == ADC_FAST) ? (1 << ADLAR) : 0) | channel;
+	// leaving ADIF alone (writing it clears it)
+	ADCSRA = (ADCSRA & ~((1 << ADIF) | (7 << ADPS0))) | (adc_ps[mode] << ADPS0);
+}
+
+// returns 1 to start the next conversion at once
+static inline uint8_t adc_complete(){
+	uint8_t admux = ADMUX;
+	uint8_t channel = admux & 0x0f;
+	if(channel == ADC_CH_VBG){
+		// ADCL first, it locks ADCH until read
+		uint16_t value = ADCL;
+		value |= ADCH << 8;
+		if(adc_vbg_settling){
+			adc_vbg_settling = 0;
+		}
+		else {
+			adc_vbg_sum += value;
+			if(++adc_vbg_count == ADC_VBG_SAMPLES){
+				adc_vbg = adc_vbg_sum >> (12 - ADC_VBG_BITS);	// 4 x 10 bits
+				adc_vbg_sum = 0;
+				adc_vbg_count = 0;
+				adc_vbg_ready = 1;
+				// back to the mic for the next trigger
+				adc_select(ADC_CH_MIC, adc_mic);
+				return 0;
+			}
+		}
+		return 1;
+	}
+
+	uint8_t pos = mic_fill_pos;
+	uint8_t size = MIC_BLOCK_SIZE;
+	if(admux & (1 << ADLAR)){
+		uint8_t value = ADCH;
+		if(admux & ADC_STANDBY){
+			adc_standby = value;
+			adc_standby_ready = 1;
+			return 0;
+		}
+		if(channel == ADC_CH_BUTTON){
+			adc_button = value;
+			adc_select(ADC_CH_MIC, adc_mic);
+			return 0;
+		}
+		mic_blocks[mic_fill].fast[pos++] = value;
+	}
+	else {
+		// precise mic, two conversions in a row summed to 11 bits
+		uint16_t v = ADCL;
+		v |= ADCH << 8;
+		size = MIC_PRECISE_SIZE;
+		if(adc_mic_odd){
+			mic_blocks[mic_fill].precise[pos++] = adc_mic_sum + v;
+		}
+		else {
+			adc_mic_sum = v;
+		}
+		adc_mic_odd ^= 1;
+	}
+
+	if(pos == size){
+		pos = 0;
+		if(mic_ready == 0){
+			// hand the block over and fill the other one
+			mic_ready = mic_fill + 1;
+			mic_fill ^= 1;
+		}
+		else {
+			// still busy with the last one, drop this one
+			mic_overruns++;
+		}
+	}
+	mic_fill_pos = pos;
+
+	// at the slow rate every conversion has its slot
+	if(!adc_mic_full || ((++adc_mic_count & (ADC_BUTTON_EVERY - 1)) == 0)){
+		adc_slot++;
+		if((adc_slot & (ADC_VCC_EVERY - 1)) == 0){
+			adc_vbg_settling = 1;
+			adc_select(ADC_CH_VBG, ADC_PRECISE);
+		}
+		else {
+			adc_select(ADC_CH_BUTTON, ADC_FAST);
+		}
+		return 1;
+	}
+	return 0;
+}
+
+ISR(ADC_vect, ISR_NOBLOCK){
+	PROF_ISR_BEGIN();
+	// nests like the timer0 tick, see there
+	uint8_t gimsk = GIMSK;
+	GIMSK = gimsk & ~(1 << INT0);
+	uint8_t next = adc_complete();
+	GIMSK = gimsk;
+	PROF_ISR_END(PROF_ADC);
+	if(next) ADCSRA |= (1 << ADSC);
+}
+
+// called once per millis from the timer interrupt, starts the slow mic
+// samples
+static inline void adc_tick(){
+	if(adc_mic_full) return;
+	if(++adc_slow_ms < ADC_SLOW_MS) return;
+	adc_slow_ms = 0;
+	// not on top of a slot that is still running or waiting for its
+	// interrupt
+	uint8_t adcsra = ADCSRA;
+	if((adcsra & ((1 << ADSC) | (1 << ADIF))) || ((ADMUX & 0x0f) != ADC_CH_MIC)) return;
+	ADCSRA = adcsra | (1 << ADSC);
+}
+
+void adc_init(){
+	// Trigger on timer0 overflow
+	ADCSRB = (4 << ADTS0);
+	// Digital input off on the mic pin
+	DIDR0 = (1 << ADC1D);
+	// ADC Enable with interrupt, auto triggered at the full rate
+	ADCSRA = (1 << ADEN) | (adc_mic_full ? (1 << ADATE) : 0) | (1 << ADIE);
+	// Voltage reference = Vcc, disconnected from PB0, the mic in its mode
+	adc_select(ADC_CH_MIC, adc_mic);
+}
+
+// Sample the mic in mode from the next trigger on, see above. Samples
+// taken so far are dropped when it changes.
+void adc_mic_mode(uint8_t mode){
+	if(mode == adc_mic) return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		adc_mic = mode;
+		// not between a button or bandgap conversion and the mic
+		if((ADMUX & 0x0f) == ADC_CH_MIC) adc_select(ADC_CH_MIC, mode);
+		mic_fill_pos = 0;
+		adc_mic_odd = 0;
+		mic_ready = 0;
+	}
+}
+
+// Sample the mic at MIC_RATE_FULL or MIC_RATE_SLOW from the next trigger
+// on, see above. Samples taken so far are dropped when it changes.
+void adc_mic_rate(uint8_t rate){
+	if(rate == adc_mic_full) return;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		adc_mic_full = rate;
+		// leaving ADIF alone
+		uint8_t adcsra = ADCSRA & ~((1 << ADIF) | (1 << ADATE));
+		ADCSRA = adcsra | (rate ? (1 << ADATE) : 0);
+		mic_fill_pos = 0;
+		adc_mic_odd = 0;
+		mic_ready = 0;
+	}
+}
+
+// Get the next full block of mic samples in the mic's mode (fast 0-255,
+// precise 0-2046) or 0 if none is ready yet. The block stays valid until
+// mic_block_release().
+const mic_samples *mic_block(){
+	uint8_t ready = mic_ready;
+	if(!ready) return 0;
+	return &mic_blocks[ready - 1];
+}
+
+void mic_block_release(){
+	mic_ready = 0;
+}
+
+/**
+ * Random numbers
+ *
+ * 16 bit xorshift (7, 9, 8), full period of 65535 and a handful of
+ * shifts per call, in place of avr-libc's rand() and its 32 bit multiply
+ * and divide. Seeded at boot from the low bits of the mic input so each
+ * sign plays its own demo order.
+ */
+uint16_t random_state = 1;
+
+// Mix the noisy low bits of 32 single mic conversions into the state,
+// called before adc_init() takes over the ADC
+void random_seed(){
+	// right adjusted, mic channel, prescaler of 8
+	ADMUX = ADC_CH_MIC;
+	for(uint8_t i = 0; i < 32; i++){
+		ADCSRA = (1 << ADEN) | (1 << ADSC) | (1 << ADPS1) | (1 << ADPS0);
+		while(ADCSRA & (1 << ADSC));
+		random_state = (random_state << 3 | random_state >> 13) ^ ADCL;
+	}
+	ADCSRA = 0;
+	// zero is the one state xorshift can't leave
+	if(!random_state) random_state = 1;
+}
+
+uint8_t random8(){
+	uint16_t x = random_state;
+	x ^= x << 7;
+	x ^= x >> 9;
+	x ^= x << 8;
+	random_state = x;
+	return x;
+}
+
+// Random number from 0 to n - 1 (n > 0), drawn from the smallest power of
+// two mask covering n and retried when out of range, so no division
+uint8_t random_below(uint8_t n){
+	uint8_t mask = n - 1;
+	mask |= mask >> 1;
+	mask |= mask >> 2;
+	mask |= mask >> 4;
+	uint8_t r;
+	do {
+		r = random8() & mask;
+	} while(r >= n);
+	return r;
 }
 
 /**
  * Save and load settings from EEPROM
+ *
+ * Settings are an 8 byte record appended to a log in half the EEPROM,
+ * so each long press wears a different
+ * slot and a cell sees 1/SETTINGS_SLOTS of the writes. Each record
+ * carries a generation that counts up by one per save; the newest valid
+ * record is the one with the highest generation in serial order, found
+ * with one pass over the slots at startup.
+ *
+ * Writes don't stall the cpu for the ~3.4 ms each byte takes: the
+ * EE_RDY interrupt feeds the bytes from a copy of the record in the
+ * background. The checksum byte goes last, so a record cut short by a
+ * reset or power loss is ignored and the previous one is used instead.
  */
-uint8_t settings_start_seq_ee EEMEM = 0;
-uint8_t settings_start_seq = 0;
+// the rest of the EEPROM holds the playlist and profile_ee
+#define	SETTINGS_SLOTS	32
+
+// modulation destinations, see mod_update()
+#define	MOD_BRIGHTNESS	0
+#define	MOD_TEMPO	1
+#define	MOD_CHANCE	2
+#define	NUM_MODS	3
+
+typedef struct {
+	uint8_t gen;
+	uint8_t playlist;	// entry to play from power up
+	uint8_t brightness;	// master brightness
+	uint8_t tempo;		// TEMPO_NORMAL plays as written, see tempo_setup()
+	uint8_t mod[NUM_MODS];	// mic modulation depths, 0 off
+	uint8_t check;		// ~sum of the bytes before it
+} settings_record;
+
+settings_record settings_log_ee[SETTINGS_SLOTS] EEMEM;
+
+#define	TEMPO_NORMAL	128
+
+settings_record settings = { 0, 0, 255, TEMPO_NORMAL, { 0, 0, 0 }, 0 };
+uint8_t settings_slot = SETTINGS_SLOTS - 1;	// slot of the newest record
+
+// background write
+settings_record settings_write;
+uint8_t settings_write_pos;
+volatile uint8_t settings_dirty = 0;	// saved again while writing
+
+uint8_t settings_check(const settings_record *r){
+	const uint8_t *p = (const uint8_t *)r;
+	uint8_t sum = 0;
+	for(uint8_t i = 0; i < sizeof(settings_record) - 1; i++){
+		sum += p[i];
+	}
+	return ~sum;
+}
+
+// start writing the current settings to the next slot
+static inline void settings_queue(){
+	settings.gen++;
+	settings.check = settings_check(&settings);
+	settings_write = settings;
+	settings_slot = (settings_slot + 1) & (SETTINGS_SLOTS - 1);
+	settings_write_pos = 0;
+	EECR |= (1 << EERIE);
+}
+
+ISR(EE_RDY_vect){
+	uint8_t pos = settings_write_pos;
+	if(pos == sizeof(settings_record)){
+		if(settings_dirty){
+			settings_dirty = 0;
+			settings_queue();
+		}
+		else {
+			EECR &= ~(1 << EERIE);
+		}
+		return;
+	}
+
+	EEAR = (uint16_t)(uintptr_t)&settings_log_ee[settings_slot] + pos;
+	EEDR = ((const uint8_t *)&settings_write)[pos];
+	// erase and write, EEPE within 4 cycles of EEMPE
+	EECR = (1 << EERIE) | (1 << EEMPE);
+	EECR |= (1 << EEPE);
+	settings_write_pos = pos + 1;
+}
 
 void load_settings(){
-	settings_start_seq = eeprom_read_byte(&settings_start_seq_ee);
+	uint8_t newest = 0, found = 0;
+	for(uint8_t i = 0; i < SETTINGS_SLOTS; i++){
+		settings_record r;
+		eeprom_read_block(&r, &settings_log_ee[i], sizeof(r));
+		if(r.check != settings_check(&r)) continue;
+		if(!found || ((int8_t)(r.gen - settings.gen) > 0)){
+			settings = r;
+			newest = i;
+			found = 1;
+		}
+	}
+	if(found) settings_slot = newest;
 }
 
+// queue a write of the settings, returns at once
 void save_settings(){
-	eeprom_update_byte(&settings_start_seq_ee, settings_start_seq);
-}
-
-// Using reset pin (1) as a button input.
-// Check for RESET going low (use voltage divider)
-// but not low enough to trigger actual reset (0.9 Vcc)
-int check_button_input(){
-	if (adc_read(0) < 1000){
-		// debounce button presses by delaying positive return
-		_delay_ms(300);
-		// reset on long press
-		if (adc_read(0) < 1000){
-			_delay_ms(3000);
-			if (adc_read(0) < 1000){
-				// blink the lights
-				for(int i = 0; i < 10; i++){
-					OCR0A = 255; // OC0A PB0 Pin 5
-					OCR0B = 255; // OC0B PB1 Pin 6
-					OCR1B = 255; // OC1B PB4 PIN 3
-					OCR1A = 255; // OC1A PB3 PIN 2
-					_delay_ms(50);
-					OCR0A = 0; // OC0A PB0 Pin 5
-					OCR0B = 0; // OC0B PB1 Pin 6
-					OCR1B = 0; // OC1B PB4 PIN 3
-					OCR1A = 0; // OC1A PB3 PIN 2
-					_delay_ms(50);
-				}
-				_delay_ms(2000);
-				save_settings();
-				reset();
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		if(EECR & (1 << EERIE)){
+			settings_dirty = 1;
+		}
+		else {
+			settings_queue();
+		}
+	}
+}
+
+// true while a save is still being written
+uint8_t settings_busy(){
+	return (EECR & (1 << EERIE)) ? 1 : 0;
+}
+
+/**
+ * Button debouncer
+ *
+ * Using reset pin (1) as a button input.
+ * Check for RESET going low (use voltage divider)
+ * but not low enough to trigger actual reset (0.9 Vcc)
+ *
+ * button_tick() runs from the millis tick and integrates the background
+ * ADC reading, so a state change has to hold for BUTTON_DEBOUNCE_MS
+ * before it counts. Press, release, held release and long press events
+ * go into a small queue that the main loop polls with button_event().
+ */
+#define	BUTTON_LEVEL	(1000 >> 2)	// ADC readings below are a press
+#define	button_down()	(adc_button < BUTTON_LEVEL)
+
+#define	BUTTON_DEBOUNCE_MS	20
+#define	BUTTON_HOLD_MS		1000
+#define	BUTTON_LONG_MS		3000
+
+#define	BUTTON_NONE	0
+#define	BUTTON_PRESS	1
+#define	BUTTON_RELEASE	2
+#define	BUTTON_LONG	3
+#define	BUTTON_HOLD_RELEASE	4	// released after BUTTON_HOLD_MS, before a long press
+
+// size must be a power of 2
+#define	BUTTON_EVENTS_SIZE	4
+volatile uint8_t button_events[BUTTON_EVENTS_SIZE];
+volatile uint8_t button_events_head = 0;
+uint8_t button_events_tail = 0;
+
+uint8_t button_integrator = 0;
+uint8_t button_state = 0;
+uint16_t button_held_ms = 0;
+uint8_t button_quiet = 0;	// the next release isn't reported, see standby()
+
+static inline void button_push_event(uint8_t event){
+	uint8_t head = button_events_head;
+	uint8_t next = (head + 1) & (BUTTON_EVENTS_SIZE - 1);
+	// drop the event if the queue is full
+	if(next != button_events_tail){
+		button_events[head] = event;
+		button_events_head = next;
+	}
+}
+
+// called once per millis from the timer interrupt
+static inline void button_tick(){
+	if(button_down()){
+		if(button_integrator < BUTTON_DEBOUNCE_MS) button_integrator++;
+	}
+	else if(button_integrator > 0){
+		button_integrator--;
+	}
+
+	if(!button_state && (button_integrator == BUTTON_DEBOUNCE_MS)){
+		button_state = 1;
+		button_held_ms = 0;
+		button_push_event(BUTTON_PRESS);
+	}
+	else if(button_state && (button_integrator == 0)){
+		button_state = 0;
+		if(button_quiet){
+			button_quiet = 0;
+		}
+		else {
+			button_push_event((button_held_ms >= BUTTON_HOLD_MS) ? BUTTON_HOLD_RELEASE : BUTTON_RELEASE);
+		}
+	}
+
+	if(button_state && (button_held_ms < BUTTON_LONG_MS)){
+		button_held_ms++;
+		if(button_held_ms == BUTTON_LONG_MS) button_push_event(BUTTON_LONG);
+	}
+}
+
+// return the next button event or BUTTON_NONE
+uint8_t button_event(){
+	uint8_t tail = button_events_tail;
+	if(tail == button_events_head) return BUTTON_NONE;
+	uint8_t event = button_events[tail];
+	button_events_tail = (tail + 1) & (BUTTON_EVENTS_SIZE - 1);
+	return event;
+}
+
+/**
+ * Channel framebuffer
+ *
+ * Sequences render into fb_back (linear brightness, CH1-CH4) and call
+ * fb_commit(), which converts the frame to PWM duties and hands it to
+ * the timer0 overflow interrupt. The interrupt latches all four channels
+ * at the same PWM boundary, so letters never update on different
+ * periods, and it only writes the channels that changed.
+ *
+ * Duties are 12 bits (see the gamma table), the PWM takes 8. Channels
+ * whose PWM period is the timer0 overflow get the other 4 bits by first
+ * order sigma-delta: every period the fraction (kept in the top nibble)
+ * is added to an accumulator and the carry adds one to the duty, so a
+ * 12 bit duty d shows as d >> 4 for 16 - f periods and one more for f of
+ * them, evenly spread, every 4 ms. That's the two timer0 channels, and
+ * timer1's with the PLL (same clock, and OCR1A/B only latch at TOP).
+ * Other timer1 periods are too slow and round to 8 bits instead. It
+ * costs ~12 cycles per channel per overflow, only for channels that have
+ * a fraction.
+ *
+ * The channels are staggered so the LEDs don't all switch on at once:
+ * OC0B and OC1B run inverted (on at the compare match, off at the end of
+ * the period) and get 255 - duty, so they sit at the end of the period
+ * while OC0A and PB3 start it, and with the PLL timer1's period starts
+ * half way through timer0's. Up to half on, no two letters of a pair are
+ * lit together. Inverted channels are on for duty ticks rather than
+ * duty + 1, so 0 is really off.
+ *
+ * On top of that fb_commit() caps the sum of the four 12 bit duties at
+ * POWER_BUDGET percent of all four full on, scaling the whole frame down
+ * when it asks for more, so a sign can be run from a supply rated for
+ * less than everything lit. The supply monitor lowers the cap further
+ * when the supply sags.
+ */
+#if defined(TIMER1_PLL) && !defined(PB3_BCM)
+#define	FB_DITHER	0x0f	// channels that can dither
+#else
+#define	FB_DITHER	0x03
+#endif
+
+#ifndef POWER_BUDGET
+#define	POWER_BUDGET	100	// percent of all four full on
+#endif
+#define	FB_BUDGET_MAX	((uint16_t)(4 * 4080L * POWER_BUDGET / 100))
+
+uint8_t fb_back[4];
+uint8_t fb_brightness = 255;	// scales every frame at commit
+uint16_t fb_total = 0;		// sum of the last committed 12 bit duties, see the supply monitor
+volatile uint8_t fb_duty[4];	// committed duties, top 8 bits
+volatile uint8_t fb_frac[4];	// and the rest, << 4
+volatile uint8_t fb_dirty = 0x0f;	// channels waiting to be latched, all at startup
+volatile uint8_t fb_dither = 0;	// channels with a fraction, latched every period
+uint8_t fb_acc[4];		// sigma-delta accumulators
+uint16_t fb_budget = FB_BUDGET_MAX;	// most fb_total may be, lowered by vcc_update()
+
+// next period's duty for channel i
+static inline uint8_t fb_dither_duty(uint8_t i){
+	uint8_t d = fb_duty[i];
+	uint8_t f = fb_frac[i];
+	uint8_t a = fb_acc[i] + f;
+	fb_acc[i] = a;
+	// carry
+	if(a < f) d++;
+	return d;
+}
+
+// called from the timer0 overflow interrupt
+static inline void fb_latch(){
+	uint8_t dither = fb_dither;
+	uint8_t dirty = fb_dirty | dither;
+	if(!dirty) return;
+	fb_dirty = 0;
+	if(dirty & 0x01) OCR0A = (dither & 0x01) ? fb_dither_duty(0) : fb_duty[0]; // OC0A PB0 Pin 5
+	if(dirty & 0x02) OCR0B = ~((dither & 0x02) ? fb_dither_duty(1) : fb_duty[1]); // OC0B PB1 Pin 6, inverted
+	if(dirty & 0x04) OCR1B = ~((dither & 0x04) ? fb_dither_duty(2) : fb_duty[2]); // OC1B PB4 PIN 3, inverted
+	if(dirty & 0x08) pb3_write((dither & 0x08) ? fb_dither_duty(3) : fb_duty[3]); // OC1A PB3 PIN 2
+}
+
+/**
+ * System clock
+ *
+ * The fuses start the chip at 1 MHz (8 MHz RC, CKDIV8). clock_set()
+ * switches the CLKPR prescaler at run time between that and the full
+ * 8 MHz for the audio modes, and moves every clock that follows it along
+ * in the same step so nothing visible changes: timer0 keeps counting
+ * microseconds (clk/1 or clk/8), which keeps millis, the 3.9 kHz PWM and
+ * the mic sample rate; timer1 keeps its tick (BCM keeps 64 cycles a tick
+ * instead, see there); the ADC clock stays at 125 kHz. With the PLL,
+ * timer1 doesn't follow the system clock and only the PB3 latency limit
+ * does.
+ *
+ * Only /1 and /8 keep timer0 on a 1 us tick, so those are the two
+ * speeds. 8 MHz wants at least 2.7 V.
+ */
+#if F_CPU != 1000000
+#error "F_CPU is the boot clock, set CLOCK=1000000"
+#endif
+
+#define	CLOCK_1MHZ	0
+#define	CLOCK_8MHZ	1
+
+// the animations' clock, BCM needs 8 MHz for its frame rate
+#ifdef PB3_BCM
+#define	CLOCK_SEQ	CLOCK_8MHZ
+#else
+#define	CLOCK_SEQ	CLOCK_1MHZ
+#endif
+
+uint8_t clock_speed = CLOCK_1MHZ;
+
+void clock_set(uint8_t speed){
+	if(speed == clock_speed) return;
+	uint8_t fast = (speed == CLOCK_8MHZ);
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		clock_prescale_set(fast ? clock_div_1 : clock_div_8);
+
+		TCCR0B = (TCCR0B & ~(7 << CS00)) | ((fast ? 2 : 1) << CS00);
+		TCCR1 = (TCCR1 & ~(15 << CS10)) | ((fast ? TIMER1_CS_8MHZ : TIMER1_CS_1MHZ) << CS10);
+#ifndef PB3_BCM
+		pb3_min_duty = fast ? PB3_MIN_DUTY(8000000L) : PB3_MIN_DUTY(1000000L);
+		// recheck the current duty against the new limit
+		fb_dirty |= 0x08;
+#endif
+		// ADC at 125 kHz precise, 250 kHz fast
+		adc_ps[ADC_PRECISE] = fast ? 6 : 3;
+		adc_ps[ADC_FAST] = fast ? 5 : 2;
+		// for the conversion set up now, leaving ADIF alone
+		uint8_t mode = (ADMUX & (1 << ADLAR)) ? ADC_FAST : ADC_PRECISE;
+		ADCSRA = (ADCSRA & ~((1 << ADIF) | (7 << ADPS0))) | (adc_ps[mode] << ADPS0);
+	}
+	clock_speed = speed;
+}
+
+/**
+ * Time reference since powerup
+ *
+ * Timer0 counts microseconds (see clock_set()), so it overflows every
+ * 256 us whatever the system clock. Each overflow adds its exact duration to a fractional accumulator counted
+ * in 8 us units (the same trick as the Arduino core), which keeps millis
+ * drift-free without dividing in the interrupt. The counters are 32 bits
+ * and must only be read through millis() and micros(), which copy them
+ * with interrupts disabled so a read can't tear.
+ *
+ * The tick is the longest interrupt that runs all the time (the 32 bit
+ * add, the button and the latch, ~150 cycles at worst), so it runs with
+ * interrupts enabled and the PB3 edges get in on time. It can't be
+ * entered again itself: the next overflow is 256 us away and nothing
+ * that nests in it takes that long, except the serial stream receiver,
+ * which is masked for the duration (it calls timer0_tick() itself, and
+ * a packet is longer than an overflow).
+ *
+ * Timer0 runs fast PWM rather than phase correct (510 us) for that
+ * 256 us: micros() can't follow a counter that counts back down, the
+ * stream receiver's bit timing and the 3.9 kHz mic rate assume it, and
+ * the PLL timer1 runs at the same rate half a period behind. It costs
+ * twice the ticks, ~19% of the cpu at 1 MHz (make bench: isr% 54 against
+ * 35 in phase correct mode, where the stream also drops frames).
+ */
+#define	MICROS_PER_OVERFLOW	256
+#define	MILLIS_INC		(MICROS_PER_OVERFLOW / 1000)
+#define	FRACT_INC		((MICROS_PER_OVERFLOW % 1000) >> 3)
+#define	FRACT_MAX		(1000 >> 3)
+
+volatile uint32_t timer0_millis = 0; // overflows after ~49 days, compare differences
+volatile uint8_t timer0_fract = 0;
+
+// one timer0 overflow, also called by the serial stream receiver
+static inline void timer0_tick(){
+	uint8_t f = timer0_fract + FRACT_INC;
+	if(f >= FRACT_MAX){
+		f -= FRACT_MAX;
+		timer0_millis += MILLIS_INC + 1;
+		button_tick();
+		adc_tick();
+	}
+	else if(MILLIS_INC){
+		timer0_millis += MILLIS_INC;
+	}
+	timer0_fract = f;
+
+	fb_latch();
+}
+
+ISR(TIMER0_OVF_vect, ISR_NOBLOCK){
+	PROF_ISR_BEGIN();
+	uint8_t gimsk = GIMSK;
+	GIMSK = gimsk & ~(1 << INT0);
+	timer0_tick();
+	GIMSK = gimsk;
+	PROF_ISR_END(PROF_T0_OVF);
+}
+
+uint32_t millis(){
+	uint32_t m;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		m = timer0_millis;
+	}
+	return m;
+}
+
+uint32_t micros(){
+	uint32_t m;
+	uint8_t f, t;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		m = timer0_millis;
+		f = timer0_fract;
+		t = TCNT0;
+		// count an overflow that hasn't been serviced yet
+		if((TIFR & (1 << TOV0)) && (t < 255)){
+			f += FRACT_INC;
+			m += MILLIS_INC;
+			if(f >= FRACT_MAX){
+				f -= FRACT_MAX;
+				m++;
 			}
 		}
-		return 1;
 	}
-	return 0;
+	return m * 1000 + ((uint16_t)f << 3) + t;
 }
 
-// Custom time reference since powerup.
-// Use timer0 overflow interrupt to count "millis" (probably not really accurate)
-uint16_t timer_interrupt_ticks = 0;
-uint64_t millis = 0; // eventually this overflows...
-ISR(TIMER0_OVF_vect){
-	timer_interrupt_ticks ++;
-	// assume timer interrupts about every 0.25ms
-	if(timer_interrupt_ticks > 4){
-		timer_interrupt_ticks = 0;
-		millis++;
+/**
+ * Mic level detector
+ *
+ * Streaming replacement for a mean absolute deviation over a ring buffer.
+ * The mean is an exponential moving average kept as a running sum of
+ * 2^MIC_MEAN_SHIFT samples, and the level is an exponentially weighted
+ * absolute deviation from that mean over 2^MIC_DEV_SHIFT samples. Each
+ * sample costs the same whatever the window sizes, and no samples are
+ * stored.
+ */
+#define	MIC_MEAN_SHIFT	9	// ~260 ms of precise samples
+#define	MIC_DEV_SHIFT	5	// ~16 ms, max 5 to fit mic_dev_sum
+
+uint32_t mic_mean_sum;
+uint16_t mic_dev_sum;
+
+void mic_reset(){
+	mic_mean_sum = (uint32_t)1024 << MIC_MEAN_SHIFT;
+	mic_dev_sum = 0;
+}
+
+static inline void mic_add_sample(uint16_t sample){
+	uint16_t mean = mic_mean_sum >> MIC_MEAN_SHIFT;
+	mic_mean_sum = mic_mean_sum - mean + sample;
+
+	uint16_t dev = (sample > mean) ? sample - mean : mean - sample;
+	mic_dev_sum = mic_dev_sum - (mic_dev_sum >> MIC_DEV_SHIFT) + dev;
+}
+
+// feed the next block of samples into the detector
+void mic_update(){
+	const mic_samples *block = mic_block();
+	if(!block) return;
+	if(adc_mic == ADC_PRECISE){
+		// the detector works on the 11 bit scale of the sums
+		for(uint8_t i = 0; i < MIC_PRECISE_SIZE; i++) mic_add_sample(block->precise[i]);
+	}
+	else {
+		// twice as many samples, so the windows are half as long
+		for(uint8_t i = 0; i < MIC_BLOCK_SIZE; i++) mic_add_sample((uint16_t)block->fast[i] << 3);
 	}
+	mic_block_release();
+}
+
+// Measure "sound" as the average deviation from the mean (0-1023)
+uint16_t mic_level(){
+	return mic_dev_sum >> (MIC_DEV_SHIFT + 1);
 }
 
 /**
- * Ring buffer for MIC samples
+ * Modulation
+ *
+ * The mic envelope as a control for every sequence, not just the mic
+ * ones. Between frames mod_update() feeds the blocks the ADC pipeline
+ * collects into the level detector and follows the level with an
+ * envelope, mod_env (0-255), that rises at once and falls by MOD_RELEASE
+ * per block. Each destination has a depth in the settings (settings.mod,
+ * 0 off) and mod_amount = depth * env >> 8 is worked out once per block,
+ * so using it costs one multiply-shift:
+ *
+ *   MOD_BRIGHTNESS	quiet dims the show by up to depth / 256, in fb_commit()
+ *   MOD_TEMPO		loud plays up to twice as fast, in scale_frame()
+ *   MOD_CHANCE		loud makes sparkles up to depth / 256 more likely
+ *
+ * The mic sequences read the blocks themselves and the stream uses the
+ * pin, so they clear mod_mic and the envelope holds until the next
+ * sequence. At 1 MHz the detector takes ~15% of the cpu, which is only
+ * spent while a depth is set.
  */
-// buffer size should be a power of 2 for efficiency
-#define	MIC_BUFFER_SIZE	16
-uint16_t mic_buffer[MIC_BUFFER_SIZE];
-int mic_buffer_current;
+#define	MOD_FLOOR	40	// mic level of a quiet room
+#define	MOD_RELEASE	8	// ~250 ms from full to nothing
+
+uint8_t mod_mic = 1;		// mod_update() may take the mic blocks
+uint8_t mod_env = 0;
+uint8_t mod_amount[NUM_MODS];
+
+void mod_update(){
+	uint8_t on = settings.mod[MOD_BRIGHTNESS] | settings.mod[MOD_TEMPO] | settings.mod[MOD_CHANCE];
+	// the mic sequences set the rate they want themselves
+	if(mod_mic) adc_mic_rate(on ? MIC_RATE_FULL : MIC_RATE_SLOW);
+	if(!on){
+		// all off, and none left over from before
+		for(uint8_t i = 0; i < NUM_MODS; i++) mod_amount[i] = 0;
+		mod_env = 0;
+		return;
+	}
+	if(!mod_mic || !mic_block()) return;
+	mic_update();
+
+	// the same range as seq12
+	uint16_t level = mic_level();
+	level = (level > MOD_FLOOR) ? level - MOD_FLOOR : 0;
+	if(level > 63) level = 63;
+	uint8_t e = level << 2;
 
-void init_mic_buffer(){
-	for(int i = 0; i < MIC_BUFFER_SIZE; i++){
-		mic_buffer[i] = (uint16_t)512;
+	if(e >= mod_env){
+		mod_env = e;
+	}
+	else {
+		mod_env = (mod_env - e > MOD_RELEASE) ? mod_env - MOD_RELEASE : e;
+	}
+	for(uint8_t i = 0; i < NUM_MODS; i++){
+		mod_amount[i] = ((uint16_t)settings.mod[i] * mod_env) >> 8;
 	}
-	mic_buffer_current = 0;
 }
 
-// Measure "sound" in mic_buffer
-// using Mean Absolute Deviation (MAD)
-uint16_t get_mic_buffer_mad(){
-	// mean
-	uint16_t total = 0;
-	for(int i = 0; i < MIC_BUFFER_SIZE; i++){
-		total = total + mic_buffer[i];
-	}
-	uint16_t mean = total / MIC_BUFFER_SIZE;
-
-	// MAD
-	uint16_t mad = 0;
-	for(int i = 0; i < MIC_BUFFER_SIZE; i++){
-		mad = mad + abs(mic_buffer[i] - mean);
-	}
-	return mad / MIC_BUFFER_SIZE;
-}
-
-
-// function prototype for LED sequences
-// return 1 if button pressed, return after timeout millis
-typedef int (*led_sequence)(int timeout);
-int seq1(int timeout);
-int seq2(int timeout);
-int seq3(int timeout);
-int seq4(int timeout);
-int seq5(int timeout);
-int seq6(int timeout);
-int seq7(int timeout);
-int seq8(int timeout);
-int seq9(int timeout);
-int seq10(int timeout);
-int seq11(int timeout);
-int seq12(int timeout);
-#define	NUM_SEQ 11
-led_sequence seq[NUM_SEQ] = {&seq1,&seq2,&seq3,&seq4,&seq5,&seq6,&seq7,&seq8,&seq9,&seq10,&seq11};
+/**
+ * Supply monitor
+ *
+ * Cheap USB supplies and battery packs sag when all four letters are
+ * full on, far enough to upset the chip (the fuses leave brown out
+ * detection off). The ADC pipeline measures the bandgap against Vcc
+ * every ~130 ms, which gives Vcc = 1.1 V * 1024 / reading, and the
+ * limiter lowers the power budget fb_commit() scales frames down to.
+ *
+ * Below VCC_LOW_MV the budget drops to 7/8 of what the last frame drew,
+ * reading after reading, until the supply holds up. Above it by
+ * VCC_HYST_MV it grows back by 1/32 of POWER_BUDGET per reading (~4 s),
+ * so frames the supply can take come back at full brightness. It never
+ * goes below 1/8 of POWER_BUDGET, so a flat battery dims the sign but
+ * doesn't turn it off.
+ *
+ * The bandgap is only within 10% from part to part, set VCC_BANDGAP_MV
+ * from a measurement for a tighter threshold.
+ */
+#ifndef VCC_LOW_MV
+#define	VCC_LOW_MV	3000	// 8 MHz wants 2.7 V
+#endif
+#define	VCC_HYST_MV	150
+#ifndef VCC_BANDGAP_MV
+#define	VCC_BANDGAP_MV	1100
+#endif
+
+#define	FB_BUDGET_MIN		(FB_BUDGET_MAX / 8)
+#define	FB_BUDGET_RECOVER	(FB_BUDGET_MAX / 32)
+
+uint16_t vcc_mv = 0;		// latest supply reading, 0 before the first
+
+void fb_commit();
+
+void vcc_update(){
+	if(!adc_vbg_ready) return;
+	uint16_t raw;
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		raw = adc_vbg;
+		adc_vbg_ready = 0;
+	}
+	if(raw == 0) return;
+	vcc_mv = ((uint32_t)VCC_BANDGAP_MV << ADC_VBG_BITS) / raw;
+
+	uint16_t budget = fb_budget;
+	if(vcc_mv < VCC_LOW_MV){
+		uint16_t drawn = fb_total - (fb_total >> 3);
+		if(drawn < budget) budget = drawn;
+		if(budget < FB_BUDGET_MIN) budget = FB_BUDGET_MIN;
+	}
+	else if(vcc_mv > VCC_LOW_MV + VCC_HYST_MV){
+		budget = (budget > FB_BUDGET_MAX - FB_BUDGET_RECOVER) ? FB_BUDGET_MAX : budget + FB_BUDGET_RECOVER;
+	}
+	if(budget != fb_budget){
+		fb_budget = budget;
+		// apply it to the frame on show
+		fb_commit();
+	}
+}
+
+/**
+ * Brightness and easing tables
+ *
+ * LEDs look much brighter at low duty than a linear scale suggests, so
+ * channel levels go through a gamma 2.2 table on the way to the PWM
+ * registers. It gives 12 bit duties for the dithering in fb_latch(),
+ * topping out at 255 << 4 so a dithered duty never carries past 255.
+ * The easing curves map the position in an EASE fade (0-64) to a level
+ * and cost one pgm_read_byte per channel per frame, which is far
+ * cheaper than evaluating them without a multiplier.
+ */
+const uint16_t gamma_table[256] PROGMEM = {
+	   0,    0,    0,    0,    0,    1,    1,    1,    2,    3,    3,    4,    5,    6,    7,    8,
+	   9,   11,   12,   13,   15,   17,   19,   21,   23,   25,   27,   29,   32,   34,   37,   40,
+	  42,   45,   48,   52,   55,   58,   62,   66,   69,   73,   77,   81,   85,   90,   94,   99,
+	 104,  108,  113,  118,  123,  129,  134,  140,  145,  151,  157,  163,  169,  175,  182,  188,
+	 195,  202,  209,  216,  223,  230,  237,  245,  253,  260,  268,  276,  284,  293,  301,  310,
+	 318,  327,  336,  345,  355,  364,  373,  383,  393,  403,  413,  423,  433,  444,  454,  465,
+	 476,  487,  498,  509,  520,  532,  543,  555,  567,  579,  591,  604,  616,  629,  642,  655,
+	 668,  681,  694,  708,  721,  735,  749,  763,  777,  791,  806,  820,  835,  850,  865,  880,
+	 896,  911,  927,  942,  958,  974,  991, 1007, 1023, 1040, 1057, 1074, 1091, 1108, 1125, 1143,
+	1161, 1178, 1196, 1214, 1233, 1251, 1270, 1288, 1307, 1326, 1345, 1365, 1384, 1404, 1423, 1443,
+	1463, 1484, 1504, 1524, 1545, 1566, 1587, 1608, 1629, 1651, 1672, 1694, 1716, 1738, 1760, 1782,
+	1805, 1827, 1850, 1873, 1896, 1919, 1943, 1966, 1990, 2014, 2038, 2062, 2087, 2111, 2136, 2160,
+	2185, 2211, 2236, 2261, 2287, 2313, 2338, 2365, 2391, 2417, 2444, 2470, 2497, 2524, 2551, 2579,
+	2606, 2634, 2662, 2690, 2718, 2746, 2774, 2803, 2832, 2861, 2890, 2919, 2949, 2978, 3008, 3038,
+	3068, 3098, 3128, 3159, 3190, 3220, 3251, 3283, 3314, 3345, 3377, 3409, 3441, 3473, 3505, 3538,
+	3571, 3603, 3636, 3669, 3703, 3736, 3770, 3804, 3838, 3872, 3906, 3941, 3975, 4010, 4045, 4080
+};
+
+#define	CURVE_STEPS	64
+
+#define	CURVE_EASE_IN_OUT	0	// smoothstep from 0 to 255
+#define	CURVE_SINE		1	// half sine from 0 up to 255 and back
+#define	CURVE_EXP_DECAY		2	// exponential decay from 255 to 0
+#define	NUM_CURVES		3
+
+const uint8_t curve_table[NUM_CURVES][CURVE_STEPS + 1] PROGMEM = {
+	{
+		  0,   0,   1,   2,   3,   4,   6,   8,  11,  14,  17,  20,  24,  27,  31,  35,
+		 40,  44,  49,  54,  59,  64,  70,  75,  81,  86,  92,  98, 104, 110, 116, 122,
+		128, 133, 139, 145, 151, 157, 163, 169, 174, 180, 185, 191, 196, 201, 206, 211,
+		215, 220, 224, 228, 231, 235, 238, 241, 244, 247, 249, 251, 252, 253, 254, 255,
+		255
+	},
+	{
+		  0,  13,  25,  37,  50,  62,  74,  86,  98, 109, 120, 131, 142, 152, 162, 171,
+		180, 189, 197, 205, 212, 219, 225, 231, 236, 240, 244, 247, 250, 252, 254, 255,
+		255, 255, 254, 252, 250, 247, 244, 240, 236, 231, 225, 219, 212, 205, 197, 189,
+		180, 171, 162, 152, 142, 131, 120, 109,  98,  86,  74,  62,  50,  37,  25,  13,
+		  0
+	},
+	{
+		255, 236, 218, 201, 186, 172, 159, 147, 136, 125, 116, 107,  99,  91,  84,  78,
+		 72,  66,  61,  56,  52,  48,  44,  41,  38,  35,  32,  29,  27,  25,  23,  21,
+		 19,  18,  16,  15,  14,  13,  11,  10,  10,   9,   8,   7,   7,   6,   5,   5,
+		  4,   4,   3,   3,   3,   2,   2,   2,   2,   1,   1,   1,   1,   0,   0,   0,
+		  0
+	}
+};
+
+/**
+ * LED sequences
+ *
+ * Each sequence is a resumable state machine: start() resets it and
+ * step(now) renders one frame and returns the number of millis until
+ * the next frame is due. Nothing in a sequence blocks, the scheduler
+ * in run_sequence() decides when frames run and polls the button in
+ * between.
+ *
+ * Most sequences are bytecode programs in flash played by the sequence
+ * engine below. Sequences that can't be expressed as data (the mic mode)
+ * have their own step function and no program.
+ */
+typedef struct {
+	const uint8_t *program;
+	void (*start)(void);
+	uint16_t (*step)(uint32_t now);
+	uint8_t hardware;	// start() sets up the clock, ADC or INT0 for it, see the crossfades
+} led_sequence;
+
+// the blocking button read used to add ~2 ms to every frame,
+// keep that in the frame times so the shows keep their pace
+#define	FRAME_MS(ms)	((ms) + 2)
+
+// state of a running sequence
+typedef struct {
+	const uint8_t *pc;	// next instruction
+	const uint8_t *loop;	// where OP_END jumps back to
+	uint8_t op;		// running instruction
+	uint8_t a, b, c;	// its arguments
+	uint8_t ms;		// its frame time
+	uint8_t phase;		// which part of the instruction is playing
+	uint8_t i;		// frame counter within the phase
+	uint16_t pos, inc;	// curve position and step (8.8 fixed point)
+	uint8_t led[4];		// channel brightness
+	int8_t direction[4];	// fade direction per channel
+} seq_state;
+
+// two so a sequence can keep running while the next fades in, see
+// run_sequence(); ss is the one whose step is running
+seq_state seq_states[2];
+seq_state *ss = &seq_states[0];
+
+// set while run_sequence() blends two sequences into the framebuffer
+uint8_t seq_fading = 0;
+
+// convert fb_back to gamma corrected duties and queue the changed
+// channels for the next PWM boundary
+void fb_commit(){
+	uint16_t d12[4];
+	uint8_t duty[4], frac[4];
+	uint8_t dither = 0;
+	uint8_t scale = fb_brightness;
+	// quiet takes away up to the depth
+	uint8_t dim = settings.mod[MOD_BRIGHTNESS] - mod_amount[MOD_BRIGHTNESS];
+	if(dim) scale = ((uint16_t)scale * (256 - dim)) >> 8;
+	uint16_t total = 0;
+	for(uint8_t i = 0; i < 4; i++){
+		uint8_t level = fb_back[i];
+		// dim before the gamma curve so it stays even to the eye
+		if(scale != 255) level = ((uint16_t)level * (scale + 1)) >> 8;
+		d12[i] = pgm_read_word(&gamma_table[level]);
+		total += d12[i];
+	}
+
+	// keep to what the supply can take, see vcc_update()
+	if(total > fb_budget){
+		uint16_t gain = ((uint32_t)fb_budget << 8) / total;
+		total = 0;
+		for(uint8_t i = 0; i < 4; i++){
+			d12[i] = ((uint32_t)d12[i] * gain) >> 8;
+			total += d12[i];
+		}
+	}
+	fb_total = total;
+
+	for(uint8_t i = 0; i < 4; i++){
+		uint16_t d = d12[i];
+		if(FB_DITHER & (1 << i)){
+			frac[i] = d << 4;
+			if(frac[i]) dither |= (1 << i);
+		}
+		else {
+			// round, the top entry has no fraction to carry
+			d += 8;
+			frac[i] = 0;
+		}
+		duty[i] = d >> 4;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		uint8_t dirty = fb_dirty;
+		for(uint8_t i = 0; i < 4; i++){
+			if((duty[i] != fb_duty[i]) || (frac[i] != fb_frac[i])){
+				fb_duty[i] = duty[i];
+				fb_frac[i] = frac[i];
+				dirty |= (1 << i);
+			}
+		}
+		fb_dirty = dirty;
+		fb_dither = dither;
+	}
+}
+
+// render the running sequence's channels
+void show_leds(){
+	// the crossfade renders both sequences itself
+	if(seq_fading) return;
+	for(uint8_t i = 0; i < 4; i++){
+		fb_back[i] = ss->led[i];
+	}
+	fb_commit();
+}
+
+void set_all_leds(uint8_t value){
+	for(uint8_t i = 0; i < 4; i++){
+		ss->led[i] = value;
+	}
+	show_leds();
+}
+
+void seq_start(){
+	// animations are slow work, the mic sequences speed up after this
+	clock_set(CLOCK_SEQ);
+	// and take the mic blocks from the modulation, which wants them at the
+	// full rate if a depth is set
+	mod_mic = 1;
+	adc_mic_mode(ADC_PRECISE);
+	adc_mic_rate(MIC_RATE_SLOW);
+	// only the stream sequence listens on PB2
+	GIMSK &= ~(1 << INT0);
+	ss->op = 0;
+	ss->phase = 0;
+	ss->i = 0;
+	for(uint8_t i = 0; i < 4; i++){
+		ss->direction[i] = 0;
+	}
+	set_all_leds(0);
+}
+
+/**
+ * Sequence engine
+ *
+ * Programs are byte strings in flash. Channels are given as a bit mask,
+ * CH1 is OC0A (PB0), CH2 OC0B (PB1), CH3 OC1B (PB4), CH4 PB3.
+ * Instructions without a frame time (SET, LOOP, END) take effect
+ * immediately, all others render one or more frames.
+ *
+ * A frame decodes at most the zero time instructions up to the next
+ * frame instruction and then updates at most 4 channels, so the cost
+ * per frame is bounded as long as every loop contains a frame
+ * instruction. Arithmetic wraps at 8 bits like the OCR registers do.
+ */
+#define	CH1	0x01
+#define	CH2	0x02
+#define	CH3	0x04
+#define	CH4	0x08
+#define	CH_ALL	0x0f
+
+#define	OP_END		0	// continue at the last LOOP (or the start)
+#define	OP_LOOP		1	// mark where END continues
+#define	OP_SET		2	// channels, level
+#define	OP_HOLD		3	// millis (16 bit), one frame
+#define	OP_RAMP		4	// up channels | down channels << 4, step, frames, frame millis
+#define	OP_FLASH	5	// channels, 0, frames, frame millis: on, off, on, ...
+#define	OP_CHASE	6	// reverse, step, peak, frame millis
+#define	OP_SPARKLE	7	// SPARKLE_IN/OUT, chance (1 in n), frames, frame millis
+#define	OP_EASE		8	// up channels | down channels << 4, curve, frames, frame millis
+
+// random fades from off to on and back, or from on to off and back
+#define	SPARKLE_IN	0
+#define	SPARKLE_OUT	1
+
+#define	END()				OP_END
+#define	LOOP()				OP_LOOP
+#define	SET(ch, level)			OP_SET, (ch), (level)
+#define	HOLD(ms)			OP_HOLD, ((ms) & 0xff), ((ms) >> 8)
+#define	RAMP_UP(ch, step, frames, ms)	OP_RAMP, (ch), (step), (frames), (ms)
+#define	RAMP_DOWN(ch, step, frames, ms)	OP_RAMP, ((ch) << 4), (step), (frames), (ms)
+#define	FLASH(ch, frames, ms)		OP_FLASH, (ch), 0, (frames), (ms)
+#define	CHASE(reverse, step, peak, ms)	OP_CHASE, (reverse), (step), (peak), (ms)
+#define	SPARKLE(mode, chance, frames, ms)	OP_SPARKLE, (mode), (chance), (frames), (ms)
+// up channels follow the curve, down channels its complement
+#define	EASE_UP(ch, curve, frames, ms)	OP_EASE, (ch), (curve), (frames), (ms)
+#define	EASE_DOWN(ch, curve, frames, ms)	OP_EASE, ((ch) << 4), (curve), (frames), (ms)
+
+void engine_start(){
+	seq_start();
+	ss->loop = ss->pc;
+}
+
+// One frame of a chase: fade in the first led, cross fade to each
+// following led and fade out the last.
+// return 1 when the chase is complete
+uint8_t chase_frame(uint8_t reverse, uint8_t step, uint8_t peak){
+	// phase is the position in the chase, i the cross fade level
+	uint8_t from = reverse ? 4 - ss->phase : ss->phase - 1;
+	uint8_t to = reverse ? 3 - ss->phase : ss->phase;
+	if(ss->phase > 0) ss->led[from] = peak - ss->i;
+	if(ss->phase < 4) ss->led[to] = ss->i;
+
+	ss->i += step;
+	if(ss->i > peak){
+		ss->i = 0;
+		ss->phase++;
+		if(ss->phase > 4) return 1;
+	}
+	return 0;
+}
+
+// One frame of random fades, where idle leds sit at 0 (SPARKLE_IN)
+// or 255 (SPARKLE_OUT) and chance sets how often one starts to move,
+// more often the louder it is with MOD_CHANCE.
+void sparkle_frame(uint8_t mode, uint8_t chance){
+	uint8_t mod = mod_amount[MOD_CHANCE];
+	if(mod){
+		chance -= ((uint16_t)chance * mod) >> 8;
+		if(chance == 0) chance = 1;
+	}
+
+	// direction of the first half of a fade
+	int8_t start = (mode == SPARKLE_IN) ? 1 : -1;
+
+	// update leds
+	for(uint8_t i = 0; i < 4; i++){
+		int8_t d = ss->direction[i];
+		if(d == 0) continue;
+		ss->led[i] += d;
+		// at the far end turn around, back where we started stop
+		if((ss->led[i] == 0) || (ss->led[i] == 255)){
+			ss->direction[i] = (d == start) ? -d : 0;
+		}
+	}
+
+	// chance of choosing an led
+	if(random_below(chance) == 0){
+		// choose random led
+		uint8_t led = random8() & 3;
+		// if led not doing anything, start it fading
+		if(0 == ss->direction[led]){
+			ss->direction[led] = start;
+		}
+	}
+}
+
+uint16_t engine_step(uint32_t now){
+	// fetch instructions until one renders a frame
+	while(ss->op == OP_END){
+		uint8_t op = pgm_read_byte(ss->pc++);
+		if(op == OP_END){
+			ss->pc = ss->loop;
+		}
+		else if(op == OP_LOOP){
+			ss->loop = ss->pc;
+		}
+		else if(op == OP_SET){
+			uint8_t ch = pgm_read_byte(ss->pc++);
+			uint8_t level = pgm_read_byte(ss->pc++);
+			for(uint8_t i = 0; i < 4; i++){
+				if(ch & (1 << i)) ss->led[i] = level;
+			}
+		}
+		else if(op == OP_HOLD){
+			uint16_t ms = pgm_read_word(ss->pc);
+			ss->pc += 2;
+			show_leds();
+			return ms;
+		}
+		else {
+			ss->op = op;
+			ss->a = pgm_read_byte(ss->pc++);
+			ss->b = pgm_read_byte(ss->pc++);
+			ss->c = pgm_read_byte(ss->pc++);
+			ss->ms = pgm_read_byte(ss->pc++);
+			ss->phase = 0;
+			ss->i = 0;
+			if(op == OP_EASE){
+				// the only division, once per instruction
+				ss->pos = 0;
+				ss->inc = (CURVE_STEPS << 8) / ss->c;
+			}
+		}
+	}
+
+	uint8_t done;
+	if(ss->op == OP_CHASE){
+		done = chase_frame(ss->a, ss->b, ss->c);
+	}
+	else {
+		if(ss->op == OP_RAMP){
+			for(uint8_t i = 0; i < 4; i++){
+				if(ss->a & (0x01 << i)) ss->led[i] += ss->b;
+				if(ss->a & (0x10 << i)) ss->led[i] -= ss->b;
+			}
+		}
+		else if(ss->op == OP_FLASH){
+			for(uint8_t i = 0; i < 4; i++){
+				if(ss->a & (1 << i)) ss->led[i] = (ss->i & 1) ? 0 : 255;
+			}
+		}
+		else if(ss->op == OP_EASE){
+			ss->pos += ss->inc;
+			// land exactly on the end of the curve
+			uint8_t step = (ss->i + 1 == ss->c) ? CURVE_STEPS : (ss->pos >> 8);
+			uint8_t level = pgm_read_byte(&curve_table[ss->b][step]);
+			for(uint8_t i = 0; i < 4; i++){
+				if(ss->a & (0x01 << i)) ss->led[i] = level;
+				if(ss->a & (0x10 << i)) ss->led[i] = 255 - level;
+			}
+		}
+		else {
+			sparkle_frame(ss->a, ss->b);
+		}
+		ss->i++;
+		done = (ss->i == ss->c);
+	}
+	if(done) ss->op = OP_END;
+
+	show_leds();
+	return ss->ms;
+}
+
+// fade each in and then out sequentially
+const uint8_t seq1[] PROGMEM = {
+	RAMP_UP(CH1, 1, 255, FRAME_MS(1)),
+	RAMP_UP(CH2, 1, 255, FRAME_MS(1)),
+	RAMP_UP(CH3, 1, 255, FRAME_MS(1)),
+	RAMP_UP(CH4, 1, 255, FRAME_MS(1)),
+	RAMP_DOWN(CH1, 1, 255, FRAME_MS(1)),
+	RAMP_DOWN(CH2, 1, 255, FRAME_MS(1)),
+	RAMP_DOWN(CH3, 1, 255, FRAME_MS(1)),
+	RAMP_DOWN(CH4, 1, 255, FRAME_MS(1)),
+	END()
+};
+
+// fade each in sequentially and then fade all out
+const uint8_t seq2[] PROGMEM = {
+	RAMP_UP(CH1, 1, 255, FRAME_MS(2)),
+	RAMP_UP(CH2, 1, 255, FRAME_MS(2)),
+	RAMP_UP(CH3, 1, 255, FRAME_MS(2)),
+	RAMP_UP(CH4, 1, 255, FRAME_MS(2)),
+	RAMP_DOWN(CH_ALL, 1, 255, FRAME_MS(4)),
+	END()
+};
+
+// flash each in sequentially and then fade all out
+const uint8_t seq3[] PROGMEM = {
+	FLASH(CH1, 5, 50),
+	HOLD(50),
+	FLASH(CH2, 5, 50),
+	HOLD(50),
+	FLASH(CH3, 5, 50),
+	HOLD(50),
+	FLASH(CH4, 5, 50),
+	HOLD(450),
+	RAMP_DOWN(CH_ALL, 1, 255, FRAME_MS(1)),
+	HOLD(500),
+	END()
+};
+
+// fade all in and then all out
+const uint8_t seq4[] PROGMEM = {
+	EASE_UP(CH_ALL, CURVE_EASE_IN_OUT, 255, FRAME_MS(1)),
+	EASE_DOWN(CH_ALL, CURVE_EASE_IN_OUT, 255, FRAME_MS(1)),
+	HOLD(100),
+	END()
+};
+
+// flash all quickly
+const uint8_t seq5[] PROGMEM = {
+	RAMP_UP(CH_ALL, 4, 63, FRAME_MS(1)),
+	RAMP_DOWN(CH_ALL, 4, 63, FRAME_MS(1)),
+	HOLD(30),
+	END()
+};
 
-int main(){
-	init_mic_buffer();
+// chase first to last
+const uint8_t seq6[] PROGMEM = {
+	CHASE(0, 2, 200, FRAME_MS(0)),
+	HOLD(100),
+	END()
+};
 
-	// Set up ADC
-	// Voltage reference = Vcc, disconnected from PB0
-	ADMUX = (0 << REFS1) | (0 << REFS0);
-	// ADC Enable and prescaler of 128
-	ADCSRA = (1 << ADEN) | (1 << ADPS2) | (1 << ADPS1) | (1 << ADPS0);
+// chase first to last then last to first
+const uint8_t seq7[] PROGMEM = {
+	CHASE(0, 2, 200, FRAME_MS(0)),
+	HOLD(100),
+	CHASE(1, 2, 200, FRAME_MS(0)),
+	HOLD(100),
+	END()
+};
 
-	// Set port B Data Direction, output pins PB4, PB3, PB1, PB0 (3, 2, 6, 5)
-	DDRB = (1 << DDB4) | (1 << DDB3) | (1 << DDB1) | (1 << DDB0);
+// emulate some type of analog brownouts, spikes, etc.
+// (the first dip wraps around to full brightness on purpose)
+const uint8_t seq8[] PROGMEM = {
+	RAMP_UP(CH_ALL, 1, 59, FRAME_MS(2)),
+	LOOP(),
+	HOLD(100 * FRAME_MS(5)),
+	RAMP_DOWN(CH_ALL, 1, 60, FRAME_MS(3)),
+	RAMP_UP(CH_ALL, 1, 60, FRAME_MS(4)),
+	HOLD(100 * FRAME_MS(10)),
+	RAMP_UP(CH_ALL, 1, 40, FRAME_MS(2)),
+	RAMP_DOWN(CH_ALL, 1, 40, FRAME_MS(2)),
+	RAMP_DOWN(CH_ALL, 1, 30, FRAME_MS(5)),
+	HOLD(100 * FRAME_MS(20)),
+	RAMP_UP(CH_ALL, 1, 30, FRAME_MS(5)),
+	HOLD(100 * FRAME_MS(30)),
+	RAMP_UP(CH_ALL, 1, 40, FRAME_MS(2)),
+	HOLD(100 * FRAME_MS(20)),
+	RAMP_DOWN(CH_ALL, 1, 40, FRAME_MS(2)),
+	END()
+};
 
-	// Set OCOA/OCOB on Compare Match, clear at bottom
-	// Configure Timer/Counter-0 for fast PWM
-	TCCR0A = (2 << COM0A0) | (2 << COM0B0) | (1 << WGM00);
-	// Enable fast PWM mode, no prescaling
-	TCCR0B = (0 << WGM02) | (1 << CS00);
+// flash all and fade out
+const uint8_t seq9[] PROGMEM = {
+	RAMP_UP(CH_ALL, 3, 85, FRAME_MS(0)),
+	HOLD(8 * FRAME_MS(1)),
+	EASE_UP(CH_ALL, CURVE_EXP_DECAY, 200, FRAME_MS(35)),
+	HOLD(100 * FRAME_MS(10)),
+	END()
+};
 
-	// Configure Timer/Counter-1
-	// Don't output to 0C1A, no prescaling
-	TCCR1 = (1 << PWM1A) | (3 << COM1A0) | (7 << CS10);
-	// Enable output on OC1B
-	GTCCR = (1 << PWM1B) | (2 << COM1B0);
+// fade letters in and out randomly
+const uint8_t seq10[] PROGMEM = {
+	SPARKLE(SPARKLE_IN, 50, 255, FRAME_MS(0)),
+	END()
+};
 
-	// Enable interrupt on matcha and overflow Timer/Counter-1, overflow t/c-0
-	TIMSK = (1 << OCIE1A) | (1 << TOIE1) | (1 << TOIE0);
+// fade letters out and in randomly
+const uint8_t seq11[] PROGMEM = {
+	SET(CH_ALL, 255),
+	LOOP(),
+	SPARKLE(SPARKLE_OUT, 100, 255, FRAME_MS(0)),
+	END()
+};
 
-	// enable interrupts
-	sei();
+/**
+ * Recorded shows
+ *
+ * Shows designed on a PC (a timeline to a song, say) are recorded as one
+ * set of four levels per frame and played back from flash. The encoder
+ * in tools/show_encode.c turns CSV frame dumps into shows.h. A show
+ * starts with its frame time in millis, then each record renders one or
+ * more frames:
+ *
+ *   0nnnnnnn		n frames (1-127) adding every channel's delta
+ *   1000cccc d...	new deltas for channels c, a signed byte each
+ *   1001cccc d...	the same two to a byte (-8..7, low nibble first)
+ *   1010cccc l...	levels for channels c, which then hold (delta 0)
+ *
+ * Delta and level records render one frame with the new values. 0 ends
+ * the show and it plays again from the top, where the encoder sets
+ * every level. Levels wrap at 8 bits like the engine's.
+ *
+ * A fade in a straight line costs one record however long it is, a
+ * hold a byte per 127 frames, anything else 2-5 bytes a frame; a run
+ * that doesn't move renders once for its whole length. The decoder
+ * keeps its place in the sequence state (levels, deltas in direction,
+ * run in i, frame time in ms), so a show takes no RAM of its own.
+ */
+#define	SHOW_END	0x00
+#define	SHOW_DELTA	0x80
+#define	SHOW_DELTA4	0x90
+#define	SHOW_LEVEL	0xa0
 
-	load_settings();
-	uint8_t settings_start_seq_applied = 0;
+#include "shows.h"
 
-	while (1) {
+void show_start(){
+	seq_start();
+	ss->ms = pgm_read_byte(ss->pc++);
+	ss->loop = ss->pc;
+}
 
-		// demo mode -- cycle through sequences until button press
-		int button_pressed = 0;
-		if(!settings_start_seq_applied){
-			if(settings_start_seq > 0){
-				button_pressed = 1;
+uint16_t show_step(uint32_t now){
+	// decode until a record renders frames
+	while(ss->i == 0){
+		uint8_t op = pgm_read_byte(ss->pc++);
+		if(op == SHOW_END){
+			ss->pc = ss->loop;
+			continue;
+		}
+		if(op < SHOW_DELTA){
+			ss->i = op;
+			break;
+		}
+		uint8_t type = op & 0xf0;
+		uint8_t b = 0, half = 0;
+		for(uint8_t i = 0; i < 4; i++){
+			if(!(op & (1 << i))) continue;
+			if(type == SHOW_LEVEL){
+				ss->led[i] = pgm_read_byte(ss->pc++);
+				ss->direction[i] = 0;
+			}
+			else if(type == SHOW_DELTA){
+				ss->direction[i] = pgm_read_byte(ss->pc++);
 			}
 			else {
-				settings_start_seq_applied = 1;
+				b = half ? (b >> 4) : pgm_read_byte(ss->pc++);
+				half = !half;
+				// sign extend the nibble
+				ss->direction[i] = ((b & 0x0f) ^ 0x08) - 0x08;
 			}
 		}
-		while(!button_pressed){
-			settings_start_seq = 0;
+		ss->i = 1;
+	}
 
-			// random led sequence
-			uint8_t randseq = (rand() % NUM_SEQ);
-			if(!button_pressed)
-				button_pressed = seq[randseq](8000);
+	uint8_t moving = 0;
+	for(uint8_t i = 0; i < 4; i++){
+		if(ss->direction[i]){
+			ss->led[i] += ss->direction[i];
+			moving = 1;
 		}
+	}
+	uint16_t ms = ss->ms;
+	if(moving){
+		ss->i--;
+	}
+	else {
+		// nothing changes until the end of the run
+		ms *= ss->i;
+		ss->i = 0;
+	}
+	show_leds();
+	return ms;
+}
 
-		// stay on each cycle
-		if(settings_start_seq_applied || settings_start_seq < 2){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 1;
-			seq1(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 3){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 2;
-			seq2(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 4){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 3;
-			seq3(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 5){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 4;
-			seq4(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 6){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 5;
-			seq5(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 7){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 6;
-			seq6(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 8){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 7;
-			seq7(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 9){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 8;
-			seq8(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 10){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 9;
-			seq9(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 11){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 10;
-			seq10(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 12){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 11;
-			seq11(-1);
-		}
-		if(settings_start_seq_applied || settings_start_seq < 13){
-			settings_start_seq_applied = 1;
-			settings_start_seq = 12;
-			seq12(-1);
+void seq12_start();
+uint16_t seq12(uint32_t now);
+void seq13_start();
+uint16_t seq13(uint32_t now);
+void stream_start();
+uint16_t stream_step(uint32_t now);
+#define	NUM_SEQ 15
+// the mic, stream and recorded sequences are not part of the demo
+#define	NUM_DEMO_SEQ 11
+led_sequence seq[NUM_SEQ] = {
+	{ seq1, &engine_start, &engine_step },
+	{ seq2, &engine_start, &engine_step },
+	{ seq3, &engine_start, &engine_step },
+	{ seq4, &engine_start, &engine_step },
+	{ seq5, &engine_start, &engine_step },
+	{ seq6, &engine_start, &engine_step },
+	{ seq7, &engine_start, &engine_step },
+	{ seq8, &engine_start, &engine_step },
+	{ seq9, &engine_start, &engine_step },
+	{ seq10, &engine_start, &engine_step },
+	{ seq11, &engine_start, &engine_step },
+	{ 0, &seq12_start, &seq12, 1 },
+	{ 0, &seq13_start, &seq13, 1 },
+	{ 0, &stream_start, &stream_step, 1 },
+	{ show_beat, &show_start, &show_step }
+};
+
+/**
+ * Standby
+ *
+ * After STANDBY_MIN minutes with no press and nothing heard the sign
+ * goes dark and sleeps. standby() turns the PWM outputs off and stops
+ * both timers (and the PLL), then spends its time in power down. Every
+ * 16 ms the watchdog interrupt wakes it to read the button and take one
+ * mic sample, each in ADC noise reduction sleep, ~250 us in all. A
+ * sample further than STANDBY_SOUND from the running mean, or the
+ * button down on two readings in a row, lights it up again within
+ * 16-32 ms, and run_sequence() returns 3 so the playlist goes back to
+ * the entry it powers up on. millis stands still meanwhile.
+ *
+ * While playing, standby_listen() checks each mic block for someone
+ * around: a swing wider than STANDBY_SOUND across every 4th conversion
+ * (~100 cycles a block), or the modulation envelope when that has taken
+ * the block. The mic and stream sequences have the mic to themselves
+ * and never idle out.
+ */
+#ifndef STANDBY_MIN
+#define	STANDBY_MIN	60	// 0 never
+#endif
+#define	STANDBY_MS	((uint32_t)STANDBY_MIN * 60000)
+#define	STANDBY_SOUND	16	// 8 bit mic steps, well above a quiet room
+#define	STANDBY_WDT	0	// WDP bits, 16 ms
+
+uint32_t standby_idle_since = 0;
+
+ISR(WDT_vect, ISR_NAKED){
+	// only wakes standby()
+	reti();
+}
+
+// between frames, after mod_update()
+void standby_listen(uint32_t now){
+	if(!mod_mic || mod_env){
+		standby_idle_since = now;
+		return;
+	}
+	// still here when the modulation is off
+	const mic_samples *block = mic_block();
+	if(!block) return;
+	uint16_t lo = 0xffff, hi = 0, sound = STANDBY_SOUND;
+	if(adc_mic == ADC_PRECISE){
+		// precise samples are 11 bit steps at half the rate
+		for(uint8_t i = 0; i < MIC_PRECISE_SIZE; i += 2){
+			uint16_t v = block->precise[i];
+			if(v < lo) lo = v;
+			if(v > hi) hi = v;
+		}
+		sound <<= 3;
+	}
+	else {
+		for(uint8_t i = 0; i < MIC_BLOCK_SIZE; i += 4){
+			uint8_t v = block->fast[i];
+			if(v < lo) lo = v;
+			if(v > hi) hi = v;
 		}
 	}
+	if(hi - lo > sound) standby_idle_since = now;
+	mic_block_release();
+}
+
+uint8_t standby_due(uint32_t now){
+#if STANDBY_MIN
+	return (now - standby_idle_since >= STANDBY_MS) && !settings_busy();
+#else
 	return 0;
+#endif
 }
 
-int delay_millis_check_button(int millisdelay){
-	int button_pressed = 0;
+// one conversion of channel in noise reduction sleep, which starts it
+uint8_t standby_read(uint8_t channel){
+	ADMUX = ADC_STANDBY | (1 << ADLAR) | channel;
+	adc_standby_ready = 0;
+	set_sleep_mode(SLEEP_MODE_ADC);
+	while(!adc_standby_ready) sleep_cpu();
+	return adc_standby;
+}
 
-	uint64_t start_time = millis;
-	while(millis < (start_time + millisdelay)){
-		if(check_button_input()) button_pressed = 1;
+void standby(){
+	clock_set(CLOCK_1MHZ);
+	// single conversions, after the pipeline's last one
+	ADCSRA = (1 << ADEN) | (1 << ADIE) | (adc_ps[ADC_FAST] << ADPS0);
+	while(ADCSRA & (1 << ADSC)) sleep_cpu();
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		// outputs off, pins low, timers stopped
+		TIMSK = 0;
+		TCCR0A = 0;
+		TCCR0B = 0;
+		GTCCR = 0;
+		TCCR1 = 0;
+		PORTB &= ~(1 << PB3);
+#ifdef TIMER1_PLL
+		PLLCSR = 0;
+#endif
+		PRR = (1 << PRTIM1) | (1 << PRTIM0) | (1 << PRUSI);
+		// watchdog interrupt only, no reset
+		WDTCR = (1 << WDCE) | (1 << WDE);
+		WDTCR = (1 << WDIE) | STANDBY_WDT;
 	}
 
-	return button_pressed;
-}
+	// mean in 4.4 fixed point, over ~16 samples
+	uint16_t mean = standby_read(ADC_CH_MIC) << 4;
+	uint8_t presses = 0;
+	while(1){
+		// ADC off for power down, until the watchdog
+		ADCSRA = (1 << ADIE) | (adc_ps[ADC_FAST] << ADPS0);
+		set_sleep_mode(SLEEP_MODE_PWR_DOWN);
+		sleep_cpu();
+		ADCSRA = (1 << ADEN) | (1 << ADIE) | (adc_ps[ADC_FAST] << ADPS0);
 
-// fade each in and then out sequentially
-int seq1(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint8_t led1 = 0, led2 = 0, led3 = 0, led4 = 0;
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		while(led1 < 255){
-			if(check_button_input()) return 1;
-			led1++;
-			OCR0A = led1; // OC0A PB0 Pin 5
-			_delay_ms(1);
-		}
-		while(led2 < 255){
-			if(check_button_input()) return 1;
-			led2++;
-			OCR0B = led2; // OC0B PB1 Pin 6
-			_delay_ms(1);
+		if(standby_read(ADC_CH_BUTTON) < BUTTON_LEVEL){
+			if(++presses == 2) break;
 		}
-		while(led3 < 255){
-			if(check_button_input()) return 1;
-			led3++;
-			OCR1B = led3; // OC1B PB4 PIN 3
-			_delay_ms(1);
-		}
-		while(led4 < 255){
-			if(check_button_input()) return 1;
-			led4++;
-			OCR1A = led4; // OC1A PB3 PIN 2
-			_delay_ms(1);
+		else {
+			presses = 0;
 		}
 
-		while(led1 > 0){
-			if(check_button_input()) return 1;
-			led1--;
-			OCR0A = led1; // OC0A PB0 Pin 5
-			_delay_ms(1);
-		}
-		while(led2 > 0){
-			if(check_button_input()) return 1;
-			led2--;
-			OCR0B = led2; // OC0B PB1 Pin 6
-			_delay_ms(1);
-		}
-		while(led3 > 0){
-			if(check_button_input()) return 1;
-			led3--;
-			OCR1B = led3; // OC1B PB4 PIN 3
-			_delay_ms(1);
-		}
-		while(led4 > 0){
-			if(check_button_input()) return 1;
-			led4--;
-			OCR1A = led4; // OC1A PB3 PIN 2
-			_delay_ms(1);
+		uint8_t mic = standby_read(ADC_CH_MIC);
+		uint8_t m = mean >> 4;
+		if(((mic > m) ? mic - m : m - mic) > STANDBY_SOUND) break;
+		mean += mic - m;
+	}
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		WDTCR = (1 << WDCE) | (1 << WDE);
+		WDTCR = 0;
+		PRR = 0;
+		if(presses){
+			// the press that woke it doesn't count
+			button_state = 1;
+			button_integrator = BUTTON_DEBOUNCE_MS;
+			button_held_ms = BUTTON_LONG_MS;
+			button_quiet = 1;
 		}
 	}
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	adc_init();
+	mic_block_release();
+	fb_dirty = 0x0f;
+	pwm_init();
+	standby_idle_since = millis();
+}
 
-	return 0;
+/**
+ * Cooperative frame scheduler
+ *
+ * Driven by the millis system tick. Frames are dispatched when due,
+ * background jobs run in the time between frames, and the rest of the
+ * time the cpu idles until the next interrupt.
+ */
+
+#ifdef PROFILE
+// frame times per sequence, in us (cycles at 1 MHz)
+typedef struct {
+	uint16_t frames;	// stops counting at 65535
+	uint16_t missed;	// frames that ran later than their tick
+	uint16_t max_us;
+	uint32_t sum_us;
+} prof_seq;
+
+prof_seq prof_seqs[NUM_SEQ];
+
+// the EEPROM dump, ~190 bytes
+typedef struct {
+	prof_isr isr[PROF_NUM_ISR];
+	uint8_t pb3_late[2];
+	prof_seq seq[NUM_SEQ];
+} profile;
+
+profile profile_ee EEMEM;
+
+void prof_frame(const led_sequence *s, uint32_t us, uint8_t late){
+	// only the sequences in the table
+	if((s < seq) || (s >= seq + NUM_SEQ)) return;
+	prof_seq *p = &prof_seqs[s - seq];
+	if(p->frames == 0xffff) return;
+	p->frames++;
+	p->sum_us += us;
+	if(us > p->max_us) p->max_us = (us > 0xffff) ? 0xffff : us;
+	if(late) p->missed++;
 }
 
-// fade each in sequentially and then fade all out
-int seq2(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint8_t led1 = 0, led2 = 0, led3 = 0, led4 = 0;
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		while(led1 < 255){
-			if(check_button_input()) return 1;
-			led1++;
-			OCR0A = led1; // OC0A PB0 Pin 5
-			_delay_ms(2);
-		}
-		while(led2 < 255){
-			if(check_button_input()) return 1;
-			led2++;
-			OCR0B = led2; // OC0B PB1 Pin 6
-			_delay_ms(2);
-		}
-		while(led3 < 255){
-			if(check_button_input()) return 1;
-			led3++;
-			OCR1B = led3; // OC1B PB4 PIN 3
-			_delay_ms(2);
-		}
-		while(led4 < 255){
-			if(check_button_input()) return 1;
-			led4++;
-			OCR1A = led4; // OC1A PB3 PIN 2
-			_delay_ms(2);
-		}
+void profile_dump(){
+	prof_isr isr[PROF_NUM_ISR];
+	uint8_t late[2];
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		for(uint8_t i = 0; i < PROF_NUM_ISR; i++) isr[i] = prof_isrs[i];
+		late[0] = prof_pb3_late[0];
+		late[1] = prof_pb3_late[1];
+	}
+	eeprom_update_block(isr, profile_ee.isr, sizeof(isr));
+	eeprom_update_block(late, profile_ee.pb3_late, sizeof(late));
+	eeprom_update_block(prof_seqs, profile_ee.seq, sizeof(prof_seqs));
+}
 
-		for(uint8_t i = 255; i > 0; i--){
-			if(check_button_input()) return 1;
-			led1--;
-			led2--;
-			led3--;
-			led4--;
-			OCR0A = led1; // OC0A PB0 Pin 5
-			OCR0B = led2; // OC0B PB1 Pin 6
-			OCR1B = led3; // OC1B PB4 PIN 3
-			OCR1A = led4; // OC1A PB3 PIN 2
-			_delay_ms(4);
-		}
+#define	PROF_FRAME_BEGIN()	uint32_t prof_frame_start = micros()
+#define	PROF_FRAME_END(s, late)	prof_frame(s, micros() - prof_frame_start, late)
+#else
+#define	PROF_FRAME_BEGIN()
+#define	PROF_FRAME_END(s, late)
+#endif
+
+// blink the lights to confirm a long press, save settings and reset
+uint16_t save_and_reset(uint32_t now){
+	if(ss->i < 20){
+		set_all_leds((ss->i & 1) ? 0 : 255);
+		ss->i++;
+		return 50;
 	}
+	if(ss->i == 20){
+		// written in the background during the pause
+		save_settings();
+		ss->i++;
+		return 2000;
+	}
+	// a reset would cut the record short
+	if(settings_busy()) return 10;
 
+#ifdef PROFILE
+	profile_dump();
+#endif
+	reset();
 	return 0;
 }
 
-// flash each in sequentially and then fade all out
-int seq3(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		if(check_button_input()) return 1;
-		OCR0A = 255; // OC0A PB0 Pin 5
-		if(delay_millis_check_button(50)) return 1;
-		OCR0A = 0; // OC0A PB0 Pin 5
-		if(delay_millis_check_button(50)) return 1;
-		OCR0A = 255; // OC0A PB0 Pin 5
-		if(delay_millis_check_button(50)) return 1;
-		OCR0A = 0; // OC0A PB0 Pin 5
-		if(delay_millis_check_button(50)) return 1;
-		OCR0A = 255; // OC0A PB0 Pin 5
-		
-		if(delay_millis_check_button(100)) return 1;
-
-		if(check_button_input()) return 1;
-		OCR0B = 255; // OC0B PB1 Pin 6
-		if(delay_millis_check_button(50)) return 1;
-		OCR0B = 0; // OC0B PB1 Pin 6
-		if(delay_millis_check_button(50)) return 1;
-		OCR0B = 255; // OC0B PB1 Pin 6
-		if(delay_millis_check_button(50)) return 1;
-		OCR0B = 0; // OC0B PB1 Pin 6
-		if(delay_millis_check_button(50)) return 1;
-		OCR0B = 255; // OC0B PB1 Pin 6
-	
-		if(delay_millis_check_button(100)) return 1;
-
-		if(check_button_input()) return 1;
-		OCR1B = 255; // OC1B PB4 PIN 3
-		if(delay_millis_check_button(50)) return 1;
-		OCR1B = 0; // OC1B PB4 PIN 3
-		if(delay_millis_check_button(50)) return 1;
-		OCR1B = 255; // OC1B PB4 PIN 3
-		if(delay_millis_check_button(50)) return 1;
-		OCR1B = 0; // OC1B PB4 PIN 3
-		if(delay_millis_check_button(50)) return 1;
-		OCR1B = 255; // OC1B PB4 PIN 3
-
-		if(delay_millis_check_button(100)) return 1;
-
-		if(check_button_input()) return 1;
-		OCR1A = 255; // OC1A PB3 PIN 2
-		if(delay_millis_check_button(50)) return 1;
-		OCR1A = 0; // OC1A PB3 PIN 2
-		if(delay_millis_check_button(50)) return 1;
-		OCR1A = 255; // OC1A PB3 PIN 2
-		if(delay_millis_check_button(50)) return 1;
-		OCR1A = 0; // OC1A PB3 PIN 2
-		if(delay_millis_check_button(50)) return 1;
-		OCR1A = 255; // OC1A PB3 PIN 2
-
-		if(delay_millis_check_button(500)) return 1;
-
-		for(uint8_t i = 255; i > 0; i--){
-			if(check_button_input()) return 1;
-			OCR0A = i; // OC0A PB0 Pin 5
-			OCR0B = i; // OC0B PB1 Pin 6
-			OCR1B = i; // OC1B PB4 PIN 3
-			OCR1A = i; // OC1A PB3 PIN 2
-			_delay_ms(1);
-		}
-		OCR0A = 0; // OC0A PB0 Pin 5
-		OCR0B = 0; // OC0B PB1 Pin 6
-		OCR1B = 0; // OC1B PB4 PIN 3
-		OCR1A = 0; // OC1A PB3 PIN 2
-
-		if(delay_millis_check_button(500)) return 1;
-	}
+const led_sequence save_and_reset_seq = { 0, &seq_start, &save_and_reset };
 
-	return 0;
+void start_sequence(const led_sequence *s){
+	ss->pc = s->program;
+	s->start();
 }
 
-// fade all in and then all out
-int seq4(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		for(int j = 0; j < 255; j++){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			_delay_ms(1);
-		}
-		for(int j = 255; j >= 0; j--){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			_delay_ms(1);
-		}
-		if(delay_millis_check_button(100)) return 1;
-	}
+/**
+ * Crossfades
+ *
+ * When run_sequence() starts a sequence, the one that ran before it
+ * keeps running in the other seq_state for transition_ms, on its own
+ * frame times, and every BLEND_MS the two sets of channels are mixed
+ * into the framebuffer, moving linearly from the old to the new. The
+ * weight is 8.8 fixed point and each channel takes one 8x8 multiply,
+ * ~60 cycles in software, so a blend with its commit is ~400 cycles:
+ * 10% of the blend period at 1 MHz, on top of the two sequences' own
+ * frames.
+ *
+ * The new sequence's start() has already run seq_start(), which puts
+ * the clock, the mic and INT0 back for the animations. The mic, spectrum
+ * and stream sequences can't run on without theirs, so the sign cuts
+ * straight from those.
+ */
+#define	TRANSITION_MS	1000	// 0 cuts straight to the next sequence
+#define	BLEND_MS	4
 
-	return 0;
+uint16_t transition_ms = TRANSITION_MS;
+
+// the sequence that ran last and when its next frame was due
+const led_sequence *seq_last = 0;
+uint32_t seq_last_next;
+
+// mix a toward b by w / 256
+uint8_t blend(uint8_t a, uint8_t b, uint8_t w){
+	if(b >= a) return a + (((uint16_t)(b - a) * w) >> 8);
+	return a - (((uint16_t)(a - b) * w) >> 8);
 }
 
-// flash all quickly
-int seq5(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		for(int j = 0; j < 255; j+=4){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			_delay_ms(1);
-		}
-		for(int j = 255; j >= 0; j-=4){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			_delay_ms(1);
-		}
-		if(delay_millis_check_button(30)) return 1;
+void blend_leds(const seq_state *from, const seq_state *to, uint8_t w){
+	for(uint8_t i = 0; i < 4; i++){
+		fb_back[i] = blend(from->led[i], to->led[i], w);
 	}
-
-	return 0;
+	fb_commit();
 }
 
-// chase first to last
-int seq6(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-
-		for(int j = 0; j < 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			// _delay_ms(1);
-		}
+// frame times are stretched by frame_scale / 256, see playlist_scale()
+uint16_t frame_scale = 256;
+
+// frames further behind than this start over from now
+#define	FRAME_CATCHUP_MS	100
+
+// the fraction of a milli each frame leaves over goes into *rem, so
+// short frames keep their average rate at any scale
+uint16_t scale_frame(uint16_t ms, uint8_t *rem){
+	uint16_t scale = frame_scale;
+	// loud takes off up to half
+	uint8_t mod = mod_amount[MOD_TEMPO];
+	if(mod) scale = ((uint32_t)scale * (512 - mod)) >> 9;
+	if(scale == 256) return ms;
+	uint32_t scaled = (uint32_t)ms * scale + *rem;
+	*rem = scaled;
+	scaled >>= 8;
+	return (scaled > 0xffff) ? 0xffff : scaled;
+}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0A = 200 - j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			// _delay_ms(1);
-		}
+// Run sequence s for timeout millis (forever if timeout < 0)
+// return 1 if button pressed, 2 if held a while, 3 back from standby,
+// return 0 after timeout
+int run_sequence(const led_sequence *s, int32_t timeout){
+	uint32_t start_time = millis();
+	uint32_t next_frame = start_time;
+	int result;
+
+	// the last sequence fades out from where it stopped
+	const led_sequence *out = seq_last;
+	seq_state *out_state = ss;
+	uint32_t next_out = seq_last_next;
+	uint32_t next_blend = start_time;
+	uint16_t fade = 0, fade_inc = 0;
+	uint8_t frame_rem = 0, out_rem = 0;
+	seq_fading = out && !out->hardware && (transition_ms > BLEND_MS);
+	if(seq_fading){
+		fade_inc = ((uint32_t)BLEND_MS << 16) / transition_ms;
+		ss = (ss == &seq_states[0]) ? &seq_states[1] : &seq_states[0];
+	}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0B = 200 - j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			// _delay_ms(1);
+	start_sequence(s);
+	while(1){
+		uint32_t now = millis();
+		if((timeout >= 0) && (now - start_time >= (uint32_t)timeout)){
+			result = 0;
+			break;
+		}
+
+		if(seq_fading && ((int32_t)(now - next_out) >= 0)){
+			seq_state *in_state = ss;
+			ss = out_state;
+			next_out += scale_frame(out->step(now), &out_rem);
+			ss = in_state;
+			if((int32_t)(now - next_out) > FRAME_CATCHUP_MS){
+				next_out = now;
+			}
 		}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1B = 200 - j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
+		if((int32_t)(now - next_frame) >= 0){
+			PROF_FRAME_BEGIN();
+			next_frame += scale_frame(s->step(now), &frame_rem);
+			PROF_FRAME_END(s, (int32_t)(now - next_frame) > 0);
+			// a late frame is made up by running the next ones back to
+			// back, so the show keeps to the clock whatever a frame
+			// costs; only a real stall starts over
+			if((int32_t)(now - next_frame) > FRAME_CATCHUP_MS){
+				next_frame = now;
+			}
 		}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1A = 200 - j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
+		if(seq_fading && ((int32_t)(now - next_blend) >= 0)){
+			next_blend += BLEND_MS;
+			if((uint16_t)(fade + fade_inc) < fade){
+				// all the way over, the new sequence renders alone
+				seq_fading = 0;
+				show_leds();
+			}
+			else {
+				fade += fade_inc;
+				blend_leds(out_state, ss, fade >> 8);
+			}
 		}
 
-		if(delay_millis_check_button(100)) return 1;
+		// after a long press the release that follows mustn't cut the
+		// save short
+		uint8_t event = (s == &save_and_reset_seq) ? BUTTON_NONE : button_event();
+		if(event != BUTTON_NONE) standby_idle_since = now;
+		if((event == BUTTON_RELEASE) || (event == BUTTON_HOLD_RELEASE)){
+			result = (event == BUTTON_RELEASE) ? 1 : 2;
+			break;
+		}
+		if(event == BUTTON_LONG){
+			// finish without returning
+			seq_fading = 0;
+			s = &save_and_reset_seq;
+			start_sequence(s);
+			next_frame = now;
+			timeout = -1;
+		}
+
+		// background work between frames
+		mod_update();
+		standby_listen(now);
+		vcc_update();
+
+		if(standby_due(now)){
+			standby();
+			result = 3;
+			break;
+		}
+
+		// nothing to do until the next milli: frames, blends and button
+		// events go by it, and a mic block or a supply reading keeps for
+		// that long, so the other interrupts (timer1's every edge, each
+		// tick, the ADC) go straight back to sleep instead of running a
+		// whole pass. The low byte can't tear.
+		uint8_t ms = timer0_millis;
+		do sleep_cpu(); while((uint8_t)timer0_millis == ms);
 	}
 
-	return 0;
+	seq_fading = 0;
+	seq_last = s;
+	seq_last_next = next_frame;
+	return result;
 }
 
-// chase first to last then last to first
-int seq7(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-
-		for(int j = 0; j < 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0A = j; // OC0A PB0 Pin 5
-			// _delay_ms(1);
-		}
+// bring up the clocks, PWM, ADC and interrupts
+void hardware_init(){
+	// 1 MHz whatever CKDIV8 says
+	clock_prescale_set(clock_div_8);
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0A = 200 - j; // OC0A PB0 Pin 5
-			OCR0B = j; // OC0B PB1 Pin 6
-			// _delay_ms(1);
-		}
+	mic_reset();
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0B = 200 - j; // OC0B PB1 Pin 6
-			OCR1B = j; // OC1B PB4 PIN 3
-			// _delay_ms(1);
-		}
+	// Seed the random numbers while the ADC is still free
+	random_seed();
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1B = 200 - j; // OC1B PB4 PIN 3
-			OCR1A = j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
-		}
+	// Set up ADC, conversions run in the background once interrupts are enabled
+	adc_init();
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1A = 200 - j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
-		}
+	// Set port B Data Direction, output pins PB4, PB3, PB1, PB0 (3, 2, 6, 5)
+	DDRB = (1 << DDB4) | (1 << DDB3) | (1 << DDB1) | (1 << DDB0);
 
-		if(delay_millis_check_button(100)) return 1;
+	pwm_init();
 
-		for(int j = 0; j < 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1A = j; // OC0A PB0 Pin 5
-			// _delay_ms(1);
-		}
+	// idle sleep keeps the timers, PWM and ADC running
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	sleep_enable();
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1A = 200 - j; // OC0A PB0 Pin 5
-			OCR1B = j; // OC0B PB1 Pin 6
-			// _delay_ms(1);
-		}
+	// enable interrupts
+	sei();
+}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR1B = 200 - j; // OC0B PB1 Pin 6
-			OCR0B = j; // OC1B PB4 PIN 3
-			// _delay_ms(1);
-		}
+/**
+ * Playlist
+ *
+ * What the sign plays is a list of entries in EEPROM, each naming a
+ * sequence and how to play it: for how long, how fast and how bright.
+ * A short press moves on to the next entry, a press held for a second
+ * goes back to the one before, and a long press saves the entry in the
+ * settings so the sign powers up on it. Moving reads just the one entry
+ * from EEPROM, so any entry is as quick to reach as the next one.
+ *
+ * An entry plays for duration seconds and then moves on, or until a
+ * press when duration is 0. PLAYLIST_DEMO plays random demo sequences
+ * for duration seconds each (8 if 0) until a press.
+ */
+#define	PLAYLIST_MAX	16
+#define	PLAYLIST_DEMO	0
+#define	PLAYLIST_END	0xff
+
+#define	PLAYLIST_SPEED	64	// sequences as written
+#define	DEMO_MS		8000
+
+typedef struct {
+	uint8_t seq;		// 1 - NUM_SEQ, PLAYLIST_DEMO, or PLAYLIST_END after the last entry
+	uint8_t duration;	// seconds, 0 until a press
+	uint8_t speed;		// PLAYLIST_SPEED / speed stretches frame times
+	uint8_t brightness;
+} playlist_entry;
+
+// the demo, then each sequence until a press
+playlist_entry playlist_ee[PLAYLIST_MAX] EEMEM = {
+	{ PLAYLIST_DEMO, 8, PLAYLIST_SPEED, 255 },
+	{ 1, 0, PLAYLIST_SPEED, 255 },
+	{ 2, 0, PLAYLIST_SPEED, 255 },
+	{ 3, 0, PLAYLIST_SPEED, 255 },
+	{ 4, 0, PLAYLIST_SPEED, 255 },
+	{ 5, 0, PLAYLIST_SPEED, 255 },
+	{ 6, 0, PLAYLIST_SPEED, 255 },
+	{ 7, 0, PLAYLIST_SPEED, 255 },
+	{ 8, 0, PLAYLIST_SPEED, 255 },
+	{ 9, 0, PLAYLIST_SPEED, 255 },
+	{ 10, 0, PLAYLIST_SPEED, 255 },
+	{ 11, 0, PLAYLIST_SPEED, 255 },
+	{ 12, 0, PLAYLIST_SPEED, 255 },
+	{ 13, 0, PLAYLIST_SPEED, 255 },
+	{ 14, 0, PLAYLIST_SPEED, 255 },
+	// full, so no PLAYLIST_END
+	{ 15, 0, PLAYLIST_SPEED, 255 }
+};
+
+uint8_t playlist_len;
+uint8_t playlist_pos;
+uint8_t playlist_home;		// the entry from power up
+playlist_entry playlist_now;
+
+// frame times for the current entry's speed at the current tempo
+void playlist_scale(){
+	uint8_t tempo = settings.tempo ? settings.tempo : TEMPO_NORMAL;
+	uint16_t speed = (uint16_t)playlist_now.speed * tempo;
+	if(speed == PLAYLIST_SPEED * TEMPO_NORMAL){
+		frame_scale = 256;
+	}
+	else {
+		uint32_t scale = ((uint32_t)PLAYLIST_SPEED * TEMPO_NORMAL << 8) / speed;
+		frame_scale = (scale > 0xffff) ? 0xffff : scale;
+	}
+}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0B = 200 - j; // OC1B PB4 PIN 3
-			OCR0A = j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
-		}
+// make entry n (wrapped to the playlist) the current one
+void playlist_go(uint8_t n){
+	if(n >= playlist_len) n = 0;
+	playlist_pos = n;
+	settings.playlist = n;
+	eeprom_read_block(&playlist_now, &playlist_ee[n], sizeof(playlist_now));
+
+	if((playlist_now.seq > NUM_SEQ) || (playlist_now.speed == 0)){
+		// a damaged entry plays the demo
+		playlist_now.seq = PLAYLIST_DEMO;
+		playlist_now.speed = PLAYLIST_SPEED;
+	}
+	playlist_scale();
+	fb_brightness = ((uint16_t)playlist_now.brightness * (settings.brightness + 1)) >> 8;
+}
 
-		for(int j = 0; j <= 200; j+=2){
-			if(check_button_input()) return 1;
-			OCR0A = 200 - j; // OC1A PB3 PIN 2
-			// _delay_ms(1);
-		}
+void playlist_next(){
+	playlist_go((playlist_pos + 1 < playlist_len) ? playlist_pos + 1 : 0);
+}
+
+void playlist_prev(){
+	playlist_go(playlist_pos ? playlist_pos - 1 : playlist_len - 1);
+}
+
+// count the entries and resume on the saved one
+void playlist_init(){
+	playlist_len = 0;
+	while((playlist_len < PLAYLIST_MAX) && (eeprom_read_byte(&playlist_ee[playlist_len].seq) != PLAYLIST_END)){
+		playlist_len++;
+	}
+	// an empty list still has the demo
+	if(playlist_len == 0) playlist_len = 1;
+	playlist_go(settings.playlist);
+	playlist_home = playlist_pos;
+}
 
-		if(delay_millis_check_button(100)) return 1;
+// play the current entry, then move to the one the button or its end picks
+void playlist_run(){
+	int32_t ms = (int32_t)playlist_now.duration * 1000;
+	int r;
+	if(playlist_now.seq == PLAYLIST_DEMO){
+		do {
+			r = run_sequence(&seq[random_below(NUM_DEMO_SEQ)], ms ? ms : DEMO_MS);
+		} while(r == 0);
+	}
+	else {
+		r = run_sequence(&seq[playlist_now.seq - 1], ms ? ms : -1);
 	}
 
-	return 0;
+	if(r == 3){
+		// dark for a while, start over as from power up
+		seq_last = 0;
+		playlist_go(playlist_home);
+	}
+	else if(r == 2){
+		playlist_prev();
+	}
+	else {
+		playlist_next();
+	}
 }
 
-// emulate some type of analog brownouts, spikes, etc.
-int seq8(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	uint64_t start_time = millis;
-	for(int i = 0; i < 60; i++){
-		if(check_button_input()) return 1;
-		OCR0A = i; // OC0A PB0 Pin 5
-		OCR0B = i; // OC0B PB1 Pin 6
-		OCR1B = i; // OC1B PB4 PIN 3
-		OCR1A = i; // OC1A PB3 PIN 2
-		_delay_ms(2);
-	}
-
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(5);
-		}
-		for(int i = 0; i < 60; i++){
-			if(check_button_input()) return 1;
-			OCR0A--; // OC0A PB0 Pin 5
-			OCR0B--; // OC0B PB1 Pin 6
-			OCR1B--; // OC1B PB4 PIN 3
-			OCR1A--; // OC1A PB3 PIN 2
-			_delay_ms(3);
-		}
-		for(int i = 0; i < 60; i++){
-			if(check_button_input()) return 1;
-			OCR0A++; // OC0A PB0 Pin 5
-			OCR0B++; // OC0B PB1 Pin 6
-			OCR1B++; // OC1B PB4 PIN 3
-			OCR1A++; // OC1A PB3 PIN 2
-			_delay_ms(4);
-		}
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(10);
-		}
-		for(int i = 0; i < 40; i++){
-			if(check_button_input()) return 1;
-			OCR0A++; // OC0A PB0 Pin 5
-			OCR0B++; // OC0B PB1 Pin 6
-			OCR1B++; // OC1B PB4 PIN 3
-			OCR1A++; // OC1A PB3 PIN 2
-			_delay_ms(2);
-		}
-		for(int i = 0; i < 40; i++){
-			if(check_button_input()) return 1;
-			OCR0A--; // OC0A PB0 Pin 5
-			OCR0B--; // OC0B PB1 Pin 6
-			OCR1B--; // OC1B PB4 PIN 3
-			OCR1A--; // OC1A PB3 PIN 2
-			_delay_ms(2);
-		}
-		for(int i = 0; i < 30; i++){
-			if(check_button_input()) return 1;
-			OCR0A--; // OC0A PB0 Pin 5
-			OCR0B--; // OC0B PB1 Pin 6
-			OCR1B--; // OC1B PB4 PIN 3
-			OCR1A--; // OC1A PB3 PIN 2
-			_delay_ms(5);
-		}
+/**
+ * Tempo
+ *
+ * Every frame time is divided by settings.tempo / TEMPO_NORMAL on top of
+ * the entry's own speed, so the whole show can be made faster or slower
+ * for a place without editing the playlist. Sequences only ever say how
+ * long a frame lasts and the scheduler keeps them to the millis clock,
+ * so the tempo is the only thing that changes how fast they play.
+ *
+ * Hold the button while powering up to set it: the current entry plays
+ * and each short press steps to the next tempo (wrapping around), a
+ * press held for a second goes back to the playlist, and a long press
+ * saves it with the other settings as usual.
+ */
+#define	TEMPO_BOOT_MS	50	// long enough to debounce the power up press
+#define	NUM_TEMPOS	5
 
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(20);
-		}
-		for(int i = 0; i < 30; i++){
-			if(check_button_input()) return 1;
-			OCR0A++; // OC0A PB0 Pin 5
-			OCR0B++; // OC0B PB1 Pin 6
-			OCR1B++; // OC1B PB4 PIN 3
-			OCR1A++; // OC1A PB3 PIN 2
-			_delay_ms(5);
-		}
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(30);
-		}
-		for(int i = 0; i < 40; i++){
-			if(check_button_input()) return 1;
-			OCR0A++; // OC0A PB0 Pin 5
-			OCR0B++; // OC0B PB1 Pin 6
-			OCR1B++; // OC1B PB4 PIN 3
-			OCR1A++; // OC1A PB3 PIN 2
-			_delay_ms(2);
-		}
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(20);
-		}
-		for(int i = 0; i < 40; i++){
-			if(check_button_input()) return 1;
-			OCR0A--; // OC0A PB0 Pin 5
-			OCR0B--; // OC0B PB1 Pin 6
-			OCR1B--; // OC1B PB4 PIN 3
-			OCR1A--; // OC1A PB3 PIN 2
-			_delay_ms(2);
+// x0.5, x0.7, x1, x1.4, x2
+const uint8_t tempo_steps[NUM_TEMPOS] PROGMEM = { 64, 90, TEMPO_NORMAL, 181, 255 };
+
+void tempo_step(){
+	uint8_t tempo = pgm_read_byte(&tempo_steps[0]);
+	for(uint8_t i = 0; i < NUM_TEMPOS; i++){
+		uint8_t t = pgm_read_byte(&tempo_steps[i]);
+		if(t > settings.tempo){
+			tempo = t;
+			break;
 		}
 	}
+	settings.tempo = tempo;
+	playlist_scale();
+}
 
-	return 0;
+// true if the button is down just after power up
+uint8_t tempo_held(){
+	while(millis() < TEMPO_BOOT_MS) sleep_cpu();
+	return button_state;
 }
 
-// flash all and fade out
-int seq9(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-	
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			OCR0A += 2; // OC0A PB0 Pin 5
-			OCR0B += 2; // OC0B PB1 Pin 6
-			OCR1B += 2; // OC1B PB4 PIN 3
-			OCR1A += 2; // OC1A PB3 PIN 2
-		}
-		for(int i = 0; i < 8; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(1);
-		}
-		for(int i = 0; i < 200; i++){
-			if(check_button_input()) return 1;
-			OCR0A--; // OC0A PB0 Pin 5
-			OCR0B--; // OC0B PB1 Pin 6
-			OCR1B--; // OC1B PB4 PIN 3
-			OCR1A--; // OC1A PB3 PIN 2
-			_delay_ms(35);
-		}
-		for(int i = 0; i < 100; i++){
-			if(check_button_input()) return 1;
-			_delay_ms(10);
-		}
+void tempo_setup(){
+	// the power up press itself doesn't count
+	uint8_t event;
+	do {
+		sleep_cpu();
+		event = button_event();
+	} while((event != BUTTON_RELEASE) && (event != BUTTON_HOLD_RELEASE));
+
+	const led_sequence *s = &seq[(playlist_now.seq == PLAYLIST_DEMO) ? 0 : playlist_now.seq - 1];
+	while(run_sequence(s, -1) == 1){
+		tempo_step();
 	}
+}
+
+int main(){
+	hardware_init();
+	load_settings();
+	playlist_init();
+	if(tempo_held()) tempo_setup();
 
+	while(1){
+		playlist_run();
+	}
 	return 0;
 }
 
-// fade letters in and out randomly
-int seq10(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
+void seq12_start(){
+	seq_start();
+	clock_set(CLOCK_8MHZ);
+	mod_mic = 0;
+	mic_reset();
+	// every sample, drops stale ones
+	adc_mic_rate(MIC_RATE_FULL);
+	mic_block_release();
+}
+
+// flash lights when we hear sounds
+uint16_t seq12(uint32_t now){
+	mic_update();
+	uint16_t mic = mic_level();
 
-	// led status (4 leds)
-	int8_t direction[4] = { 0, 0, 0, 0 };
-	uint8_t brightness[4] = { 0, 0, 0, 0 };
+	// try to eliminate noise floor
+	if(mic > 40){
+		mic = mic - 40;
+	}
+	else {
+		mic = 0;
+	}
 
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
+	// scale up, avoiding overflow
+	if(mic > 63) mic = 63;
+	mic = mic<<2;
 
-		if(check_button_input()) return 1;
+	set_all_leds((uint8_t)mic);
 
-		// update leds
-		for(uint8_t i = 0; i < 4; i++){
-			// if inc but not max, inc
-			if((direction[i] > 0) && brightness[i] < 255){
-				brightness[i]++;
-				// if max, dec
-				if(brightness[i] >= 255){
-					brightness[i] = 255;
-					direction[i] = -1;
-				}
-			}
-			// if dec but not min, dec
-			else if(direction[i] < 0){
-				if(brightness[i] > 0){
-					brightness[i]--;
-				}
-				// if min, stop
-				if(brightness[i] <= 0){
-					brightness[i] = 0;
-					direction[i] = 0;
-				}
-			}
-		}
+	return FRAME_MS(0);
+}
 
+/**
+ * Four band spectrum
+ *
+ * Goertzel filters on bins 2, 4, 8 and 12 of each 32 sample mic block
+ * (244, 488, 977 and 1465 Hz at 3.9 kHz) drive CH1-CH4. The ATtiny85 has
+ * no multiplier, so the bin coefficients 2cos(2 pi k / 32) = 1.848, 1.414,
+ * 0 and -1.414 and the final cos/sin rotation are applied as shifts and
+ * adds (within 0.2%).
+ *
+ * Budget, estimated from the shift counts: ~90 cycles per sample for all
+ * four recurrences, ~3k cycles per 8.2 ms block, plus a few hundred for
+ * the magnitudes and envelopes. That would be ~40% of the cpu at 1 MHz,
+ * so the sequence runs at 8 MHz (~5%). A block that isn't picked up in
+ * time is dropped by the ADC interrupt rather than stalling it.
+ */
+#define	MUL_1_848(s)	(((s) << 1) - ((s) >> 3) - ((s) >> 5) + ((s) >> 8))
+#define	MUL_1_414(s)	((s) + ((s) >> 2) + ((s) >> 3) + ((s) >> 5) + ((s) >> 7))
+#define	MUL_0_924(s)	((s) - ((s) >> 4) - ((s) >> 6))
+#define	MUL_0_707(s)	(((s) >> 1) + ((s) >> 3) + ((s) >> 4) + ((s) >> 6))
+#define	MUL_0_383(s)	(((s) >> 2) + ((s) >> 3) + ((s) >> 7))
+
+// per band: magnitude shift to 0-255, noise floor, attack and decay shifts
+const uint8_t spectrum_bands[4][4] PROGMEM = {
+	{ 3, 8, 1, 4 },	// bass, slow decay
+	{ 2, 8, 1, 3 },	// low mid
+	{ 2, 6, 0, 3 },	// high mid
+	{ 1, 6, 0, 2 }	// treble, fast decay
+};
+
+// |re + j im| approximated as max + min / 2
+uint16_t approx_mag(int16_t re, int16_t im){
+	uint16_t a = (re < 0) ? -re : re;
+	uint16_t b = (im < 0) ? -im : im;
+	return (a > b) ? a + (b >> 1) : b + (a >> 1);
+}
+
+// move value toward target by 1/2^shift of the distance, at least by one
+uint8_t approach(uint8_t value, uint8_t target, uint8_t shift){
+	if(target > value){
+		uint8_t d = (target - value) >> shift;
+		return value + (d ? d : 1);
+	}
+	if(target < value){
+		uint8_t d = (value - target) >> shift;
+		return value - (d ? d : 1);
+	}
+	return value;
+}
 
-		OCR0A = brightness[0];
-		OCR0B = brightness[1];
-		OCR1A = brightness[2];
-		OCR1B = brightness[3];
+// run the four filters over one block
+void spectrum_block(const uint8_t *block, uint16_t *mag){
+	int16_t a1 = 0, a2 = 0, b1 = 0, b2 = 0, c1 = 0, c2 = 0, d1 = 0, d2 = 0;
+	for(uint8_t i = 0; i < MIC_BLOCK_SIZE; i++){
+		int16_t x = (int16_t)block[i] - 128;
+		int16_t s;
+		s = x + MUL_1_848(a1) - a2; a2 = a1; a1 = s;
+		s = x + MUL_1_414(b1) - b2; b2 = b1; b1 = s;
+		s = x - c2; c2 = c1; c1 = s;
+		s = x - MUL_1_414(d1) - d2; d2 = d1; d1 = s;
+	}
 
+	// X = s1 - e^-jw s2, so re = s1 - cos(w) s2, im = sin(w) s2
+	mag[0] = approx_mag(a1 - MUL_0_924(a2), MUL_0_383(a2));
+	mag[1] = approx_mag(b1 - MUL_0_707(b2), MUL_0_707(b2));
+	mag[2] = approx_mag(c1, c2);
+	mag[3] = approx_mag(d1 + MUL_0_707(d2), MUL_0_707(d2));
+}
 
-		// chance of choosing an led
-		if((rand() % 50) == 0){
-			// choose random led
-			uint8_t led = (rand() % 4);
-			// if led not doing anything, make it light up
-			if(0 == direction[led]){
-				direction[led] = 1;
-			}
+void seq13_start(){
+	seq_start();
+	clock_set(CLOCK_8MHZ);
+	mod_mic = 0;
+	// the bands want the whole swing at every sample, drops stale ones
+	adc_mic_mode(ADC_FAST);
+	adc_mic_rate(MIC_RATE_FULL);
+}
+
+// light each letter by its own frequency band
+uint16_t seq13(uint32_t now){
+	const mic_samples *block = mic_block();
+	if(block){
+		uint16_t mag[4];
+		spectrum_block(block->fast, mag);
+		mic_block_release();
+
+		for(uint8_t i = 0; i < 4; i++){
+			uint8_t shift = pgm_read_byte(&spectrum_bands[i][0]);
+			uint8_t floor = pgm_read_byte(&spectrum_bands[i][1]);
+			uint16_t m = mag[i] >> shift;
+			uint8_t level = (m > 255 + floor) ? 255 : (m > floor) ? m - floor : 0;
+
+			// follow the band level with its attack and decay
+			uint8_t rate = pgm_read_byte(&spectrum_bands[i][(level > ss->led[i]) ? 2 : 3]);
+			ss->led[i] = approach(ss->led[i], level, rate);
 		}
+		show_leds();
 	}
 
-	return 0;
+	// a block is ready every 8 ms
+	return 2;
 }
 
-// fade letters out and in randomly
-int seq11(int timeout){
-	OCR0A = 255; // OC0A PB0 Pin 5
-	OCR0B = 255; // OC0B PB1 Pin 6
-	OCR1B = 255; // OC1B PB4 PIN 3
-	OCR1A = 255; // OC1A PB3 PIN 2
+/**
+ * Serial stream input
+ *
+ * Sequence 14 lets a controller drive the sign: frames of four
+ * brightness levels go straight to the leds, and commands pick a built
+ * in sequence or set parameters. The USI can't be used, its DI and DO
+ * pins are CH1 and CH2, so this is a receive only software UART on PB2
+ * (pin 7, INT0) in place of the mic, 57600 baud 8N1 (8N2 gives more
+ * margin), 0-5 V.
+ *
+ * Every packet is one burst of bytes with a gap of at least
+ * STREAM_GAP_US (four bit times, ~70 us) before the next, which is all
+ * the framing there is:
+ *
+ *   0xff, STREAM_FRAME, ch1, ch2, ch3, ch4	show a frame
+ *   0xff, STREAM_SELECT, n			play sequence n (1-11), 0 for frames
+ *   0xff, STREAM_PARAM, id, value		set stream_params[id]
+ *
+ * Parameters from STREAM_PARAM_MOD on set the mic modulation depths in
+ * the settings instead (MOD_BRIGHTNESS first), so a controller can set
+ * up an installation; a long press saves them.
+ *
+ * The leading 0xff is only there for its start bit: that edge runs the
+ * INT0 interrupt, which may start late behind the other interrupts, so
+ * the byte is skipped. The interrupt then polls the rest of the packet
+ * with exact timing and returns at the gap: six bytes of 174 us and the
+ * gap, ~1.1 ms for a frame, with the cpu taken for all of it. Timer0
+ * overflows are serviced inline meanwhile, so the timebase and the
+ * framebuffer latch keep running, but the ADC loses a conversion and
+ * PB3's software PWM stalls: this is the longest hold-off its edges see,
+ * see the PWM notes at the top of the file.
+ *
+ * Frames wait in a ring of STREAM_RING and are shown as they come, at
+ * most ~900 fps by the wire, less what the main loop needs between
+ * packets; a full ring drops new frames. The stream runs at 8 MHz for
+ * the timing.
+ */
+#define	STREAM_BAUD	57600
+#define	STREAM_GAP_US	((4 * 1000000L) / STREAM_BAUD)	// end of packet
+#define	STREAM_BYTE_US	((10 * 1000000L) / STREAM_BAUD)
 
-	// led status (4 leds)
-	int8_t direction[4] = { 0, 0, 0, 0 };
-	uint8_t brightness[4] = { 255, 255, 255, 255 };
+// microseconds from the start edge to the middle of data bit i
+#define	STREAM_SAMPLE_US(i)	(((2 * (i) + 3) * 500000L + STREAM_BAUD / 2) / STREAM_BAUD)
 
-	uint64_t start_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
+#define	STREAM_FRAME	0x01
+#define	STREAM_SELECT	0x02
+#define	STREAM_PARAM	0x03
 
-		if(check_button_input()) return 1;
+#define	STREAM_MAX_PACKET	5	// command and payload
 
-		// update leds
-		for(uint8_t i = 0; i < 4; i++){
-			// if dec but not min, dec
-			if((direction[i] < 0) && brightness[i] > 0){
-				brightness[i]--;
-				// if min, inc 
-				if(brightness[i] <= 0){
-					brightness[i] = 0;
-					direction[i] = 1;
-				}
-			}
-			// if inc but not max, inc
-			else if(direction[i] > 0){
-				if(brightness[i] < 255){
-					brightness[i]++;
-				}
-				// if max, stop
-				if(brightness[i] >= 255){
-					brightness[i] = 255;
-					direction[i] = 0;
-				}
-			}
-		}
+// parameters
+#define	STREAM_PARAM_IDLE_SEQ	0	// play this sequence after a second without frames, 0 holds the last frame
+#define	NUM_STREAM_PARAMS	1
+#define	STREAM_PARAM_MOD	0x10	// + MOD_*, settings.mod
+
+// size must be a power of 2
+#define	STREAM_RING	4
+#define	STREAM_IDLE_MS	1000
 
+const uint8_t stream_sample_us[8] PROGMEM = {
+	STREAM_SAMPLE_US(0), STREAM_SAMPLE_US(1), STREAM_SAMPLE_US(2), STREAM_SAMPLE_US(3),
+	STREAM_SAMPLE_US(4), STREAM_SAMPLE_US(5), STREAM_SAMPLE_US(6), STREAM_SAMPLE_US(7)
+};
 
-		OCR0A = brightness[0];
-		OCR0B = brightness[1];
-		OCR1A = brightness[2];
-		OCR1B = brightness[3];
+uint8_t stream_frames[STREAM_RING][4];
+volatile uint8_t stream_head = 0;	// written by the interrupt
+uint8_t stream_tail = 0;
+volatile uint8_t stream_drops = 0;	// frames lost to a full ring
 
+// one command at a time for the main loop, 0 when empty
+volatile uint8_t stream_cmd = 0;
+uint8_t stream_args[2];
 
-		// chance of choosing an led
-		if((rand() % 100) == 0){
-			// choose random led
-			uint8_t led = (rand() % 4);
-			// if led not doing anything, make it fade out
-			if(0 == direction[led]){
-				direction[led] = -1;
+uint8_t stream_params[NUM_STREAM_PARAMS];
+
+// wait for PB2 to read level, false after timeout us
+static inline uint8_t stream_wait(uint8_t level, uint8_t timeout){
+	uint8_t t = TCNT0;
+	while(((PINB >> PINB2) & 1) != level){
+		if((uint8_t)(TCNT0 - t) > timeout) return 0;
+	}
+	return 1;
+}
+
+static inline void stream_packet(const uint8_t *buf, uint8_t n){
+	uint8_t cmd = buf[0];
+	if((cmd == STREAM_FRAME) && (n == 5)){
+		uint8_t h = stream_head;
+		uint8_t next = (h + 1) & (STREAM_RING - 1);
+		if(next == stream_tail){
+			stream_drops++;
+			return;
+		}
+		for(uint8_t i = 0; i < 4; i++){
+			stream_frames[h][i] = buf[i + 1];
+		}
+		stream_head = next;
+	}
+	else if(((cmd == STREAM_SELECT) && (n == 2)) || ((cmd == STREAM_PARAM) && (n == 3))){
+		// the main loop hasn't taken the last one, drop this one
+		if(stream_cmd) return;
+		stream_args[0] = buf[1];
+		stream_args[1] = buf[2];
+		stream_cmd = cmd;
+	}
+}
+
+ISR(INT0_vect){
+	uint8_t buf[STREAM_MAX_PACKET];
+	uint8_t n = 0;
+
+	// ride out the preamble, high from its first data bit to its stop bit,
+	// which is longer than the gap
+	if(stream_wait(1, STREAM_GAP_US)){
+		uint8_t timeout = STREAM_BYTE_US;
+		while(n < STREAM_MAX_PACKET){
+			// next start bit, or the end of the packet
+			if(!stream_wait(0, timeout)) break;
+			timeout = STREAM_GAP_US;
+			uint8_t t = TCNT0;
+
+			uint8_t byte = 0;
+			for(uint8_t i = 0; i < 8; i++){
+				uint8_t at = pgm_read_byte(&stream_sample_us[i]);
+				while((uint8_t)(TCNT0 - t) < at);
+				byte >>= 1;
+				if(PINB & (1 << PINB2)) byte |= 0x80;
+			}
+			buf[n++] = byte;
+
+			// keep time, there are 1.5 bits to the next start bit
+			if(TIFR & (1 << TOV0)){
+				TIFR = (1 << TOV0);
+				timer0_tick();
 			}
+
+			// stop bit
+			if(!stream_wait(1, STREAM_GAP_US)) break;
 		}
 	}
 
-	return 0;
+	if(n) stream_packet(buf, n);
+	// the data bits' own falling edges
+	GIFR = (1 << INTF0);
 }
 
-// flash lights when we hear sounds
-int seq12(int timeout){
-	OCR0A = 0; // OC0A PB0 Pin 5
-	OCR0B = 0; // OC0B PB1 Pin 6
-	OCR1B = 0; // OC1B PB4 PIN 3
-	OCR1A = 0; // OC1A PB3 PIN 2
-
-	init_mic_buffer();
-
-	uint64_t start_time = millis;
-	uint8_t leds = 0;
-	uint16_t led_time = millis;
-	while((timeout < 0) || (millis < (start_time + (uint64_t)timeout))){
-		// update mic buffer
-		mic_buffer[mic_buffer_current] = adc_read(1);
-		mic_buffer_current++;
-		mic_buffer_current = mic_buffer_current % MIC_BUFFER_SIZE;
-	
-		uint16_t mic = get_mic_buffer_mad();
-	
-
-		// try to eliminate noise floor
-		if(mic > 40){ 
-			mic = mic - 40;
-		}
-	      	else {
-			mic = 0;
-		}
+const led_sequence *stream_playing;	// sequence picked by the controller, or 0
+uint32_t stream_next;			// its next frame
+uint32_t stream_last_frame;
+
+// listen on PB2, again after starting a picked sequence
+void stream_listen(){
+	clock_set(CLOCK_8MHZ);
+	mod_mic = 0;
+	DIDR0 &= ~(1 << ADC1D);
+	// falling edge
+	MCUCR = (MCUCR & ~(3 << ISC00)) | (2 << ISC00);
+	GIFR = (1 << INTF0);
+	GIMSK |= (1 << INT0);
+}
 
-		// scale up, avoiding overflow
-		if(mic > 63) mic = 63;
-		mic = mic<<2;
+void stream_play(uint8_t n, uint32_t now){
+	if((n == 0) || (n > NUM_DEMO_SEQ)){
+		stream_playing = 0;
+		return;
+	}
+	stream_playing = &seq[n - 1];
+	start_sequence(stream_playing);
+	stream_listen();
+	stream_next = now;
+}
 
-		leds = (uint8_t)mic;
+void stream_start(){
+	seq_start();
+	stream_tail = stream_head;
+	stream_playing = 0;
+	stream_last_frame = millis();
+	stream_listen();
+}
 
-		OCR0A = leds;
-		OCR0B = leds;
-		OCR1B = leds;
-		OCR1A = leds;
+uint16_t stream_step(uint32_t now){
+	uint8_t cmd = stream_cmd;
+	if(cmd == STREAM_SELECT){
+		stream_play(stream_args[0], now);
+	}
+	else if(cmd == STREAM_PARAM){
+		uint8_t id = stream_args[0];
+		if(id < NUM_STREAM_PARAMS){
+			stream_params[id] = stream_args[1];
+		}
+		else if((uint8_t)(id - STREAM_PARAM_MOD) < NUM_MODS){
+			settings.mod[id - STREAM_PARAM_MOD] = stream_args[1];
+		}
+	}
+	stream_cmd = 0;
 
-		// fade out leds
-		if(millis > led_time + 1){
-			led_time = millis;
-			if(leds > 0){
-				leds--;
-			}
+	uint8_t t = stream_tail;
+	if(t != stream_head){
+		// frames take over from any sequence
+		stream_playing = 0;
+		stream_last_frame = now;
+		for(uint8_t i = 0; i < 4; i++){
+			ss->led[i] = stream_frames[t][i];
 		}
-		if(check_button_input()) return 1;
+		stream_tail = (t + 1) & (STREAM_RING - 1);
+		show_leds();
+	}
+	else if(!stream_playing && stream_params[STREAM_PARAM_IDLE_SEQ] && (now - stream_last_frame >= STREAM_IDLE_MS)){
+		stream_play(stream_params[STREAM_PARAM_IDLE_SEQ], now);
 	}
 
-	return 0;
+	if(stream_playing && ((int32_t)(now - stream_next) >= 0)){
+		stream_next += stream_playing->step(now);
+	}
+
+	// poll every tick
+	return 1;
 }
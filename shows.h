@@ -0,0 +1,42 @@
+// generated by tools/show_encode, don't edit
+
+// shows/beat.csv: 400 frames of 20 ms, 8.0 s in 443 bytes
+const uint8_t show_beat[] PROGMEM = {
+	0x14, 0xaf, 0xff, 0x00, 0x00, 0x00, 0x81, 0xda, 0x81, 0xdf, 0x81, 0xe5,
+	0x81, 0xe8, 0x81, 0xec, 0x81, 0xef, 0x81, 0xf2, 0x81, 0xf3, 0x81, 0xf6,
+	0x81, 0xf7, 0x91, 0x09, 0x01, 0x91, 0x0b, 0x01, 0x91, 0x0c, 0x91, 0x0d,
+	0x01, 0x91, 0x0e, 0x03, 0x91, 0x0f, 0x02, 0x93, 0xfb, 0x83, 0x00, 0xda,
+	0x82, 0xdf, 0x82, 0xe5, 0x82, 0xe8, 0x82, 0xec, 0x82, 0xef, 0x82, 0xf2,
+	0x82, 0xf3, 0x82, 0xf6, 0x82, 0xf7, 0x92, 0x09, 0x01, 0x92, 0x0b, 0x01,
+	0x92, 0x0c, 0x92, 0x0d, 0x01, 0x92, 0x0e, 0x03, 0x92, 0x0f, 0x02, 0x96,
+	0xfb, 0x86, 0x00, 0xda, 0x84, 0xdf, 0x84, 0xe5, 0x84, 0xe8, 0x84, 0xec,
+	0x84, 0xef, 0x84, 0xf2, 0x84, 0xf3, 0x84, 0xf6, 0x84, 0xf7, 0x94, 0x09,
+	0x01, 0x94, 0x0b, 0x01, 0x94, 0x0c, 0x94, 0x0d, 0x01, 0x94, 0x0e, 0x03,
+	0x94, 0x0f, 0x02, 0x9c, 0xfb, 0x8c, 0x00, 0xda, 0x88, 0xdf, 0x88, 0xe5,
+	0x88, 0xe8, 0x88, 0xec, 0x88, 0xef, 0x88, 0xf2, 0x88, 0xf3, 0x88, 0xf6,
+	0x88, 0xf7, 0x98, 0x09, 0x01, 0x98, 0x0b, 0x01, 0x98, 0x0c, 0x98, 0x0d,
+	0x01, 0x98, 0x0e, 0x03, 0x98, 0x0f, 0x02, 0x98, 0x0b, 0x89, 0x0b, 0x00,
+	0x16, 0x91, 0x02, 0x91, 0x00, 0x82, 0x0b, 0x16, 0x92, 0x02, 0x92, 0x00,
+	0x84, 0x0b, 0x16, 0x94, 0x02, 0x94, 0x00, 0x88, 0x0b, 0x16, 0x98, 0x02,
+	0x9e, 0x11, 0x01, 0x8f, 0xf6, 0x0a, 0x00, 0x00, 0x01, 0x83, 0xf5, 0x0b,
+	0x83, 0xf6, 0x0a, 0x03, 0x83, 0xf5, 0x0b, 0x83, 0xf6, 0x0a, 0x03, 0x83,
+	0xf5, 0x0b, 0x83, 0xf6, 0x0a, 0x03, 0x83, 0xf5, 0x0b, 0x83, 0xf6, 0x0a,
+	0x03, 0x83, 0xf5, 0x0b, 0x83, 0xf6, 0x0a, 0x01, 0x87, 0x00, 0xf6, 0x0a,
+	0x01, 0x86, 0xf5, 0x0b, 0x86, 0xf6, 0x0a, 0x03, 0x86, 0xf5, 0x0b, 0x86,
+	0xf6, 0x0a, 0x03, 0x86, 0xf5, 0x0b, 0x86, 0xf6, 0x0a, 0x03, 0x86, 0xf5,
+	0x0b, 0x86, 0xf6, 0x0a, 0x03, 0x86, 0xf5, 0x0b, 0x86, 0xf6, 0x0a, 0x01,
+	0x8e, 0x00, 0xf6, 0x0a, 0x01, 0x8c, 0xf5, 0x0b, 0x8c, 0xf6, 0x0a, 0x03,
+	0x8c, 0xf5, 0x0b, 0x8c, 0xf6, 0x0a, 0x03, 0x8c, 0xf5, 0x0b, 0x8c, 0xf6,
+	0x0a, 0x03, 0x8c, 0xf5, 0x0b, 0x8c, 0xf6, 0x0a, 0x03, 0x8c, 0xf5, 0x0b,
+	0x8c, 0xf6, 0x0a, 0x01, 0x8d, 0x0a, 0x00, 0xf6, 0x01, 0x89, 0x0b, 0xf5,
+	0x89, 0x0a, 0xf6, 0x03, 0x89, 0x0b, 0xf5, 0x89, 0x0a, 0xf6, 0x03, 0x89,
+	0x0b, 0xf5, 0x89, 0x0a, 0xf6, 0x03, 0x89, 0x0b, 0xf5, 0x89, 0x0a, 0xf6,
+	0x03, 0x89, 0x0b, 0xf5, 0x89, 0x0a, 0xf6, 0x8e, 0xff, 0xff, 0xf5, 0x8f,
+	0xec, 0xec, 0xec, 0xec, 0x0b, 0x8f, 0xf1, 0xf1, 0xf1, 0xf1, 0x9f, 0x00,
+	0x00, 0x0a, 0x9f, 0xff, 0xff, 0x8f, 0xec, 0xec, 0xec, 0xec, 0x0b, 0x8f,
+	0xf1, 0xf1, 0xf1, 0xf1, 0x9f, 0x00, 0x00, 0x0a, 0x9f, 0xff, 0xff, 0x8f,
+	0xec, 0xec, 0xec, 0xec, 0x0a, 0x8f, 0xdc, 0xdc, 0xdc, 0xdc, 0x8f, 0xec,
+	0xec, 0xec, 0xec, 0x0a, 0x8f, 0xdc, 0xdc, 0xdc, 0xdc, 0x9f, 0x00, 0x00,
+	0x8f, 0xec, 0xec, 0xec, 0xec, 0x0a, 0x8f, 0xdc, 0xdc, 0xdc, 0xdc, 0x8f,
+	0xec, 0xec, 0xec, 0xec, 0x0a, 0x8f, 0xdc, 0xdc, 0xdc, 0xdc, 0x00
+};
@@ -0,0 +1,29 @@
+/*
+ * Host stand-in for avr/eeprom.h, backed by sim_eeprom[]
+ */
+#ifndef SIM_AVR_EEPROM_H
+#define SIM_AVR_EEPROM_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+extern uint8_t sim_eeprom[512];
+uint8_t *sim_eeprom_addr(const void *p);
+
+// EEMEM variables live in their own section, placed at 0 on the chip
+#define	EEMEM	__attribute__((section("sim_eeprom")))
+
+#define	eeprom_read_byte(p)		(*sim_eeprom_addr(p))
+#define	eeprom_write_byte(p, v)		(*sim_eeprom_addr(p) = (v))
+#define	eeprom_update_byte(p, v)	(*sim_eeprom_addr(p) = (v))
+#define	eeprom_busy_wait()
+
+static inline void eeprom_read_block(void *dst, const void *src, size_t n){
+	for(size_t i = 0; i < n; i++) ((uint8_t *)dst)[i] = *sim_eeprom_addr((const uint8_t *)src + i);
+}
+
+static inline void eeprom_update_block(const void *src, void *dst, size_t n){
+	for(size_t i = 0; i < n; i++) *sim_eeprom_addr((uint8_t *)dst + i) = ((const uint8_t *)src)[i];
+}
+
+#endif
@@ -0,0 +1,27 @@
+/*
+ * Host stand-in for avr/interrupt.h
+ *
+ * ISRs become plain functions that sim.c calls between main loop
+ * passes, so they never preempt the main loop. The attributes turn into
+ * a flags byte next to each one (vector_sim_flags) that sim.c uses to
+ * tell which interrupts hold the others off.
+ */
+#ifndef SIM_AVR_INTERRUPT_H
+#define SIM_AVR_INTERRUPT_H
+
+#include <avr/io.h>
+
+#define	SIM_ISR_NAKED	0x01
+#define	SIM_ISR_NOBLOCK	0x02
+
+#define	ISR(vector, ...)	const uint8_t vector##_sim_flags = 0 __VA_ARGS__; \
+				void vector(void); void vector(void)
+#define	ISR_NAKED	| SIM_ISR_NAKED
+#define	ISR_BLOCK
+#define	ISR_NOBLOCK	| SIM_ISR_NOBLOCK
+#define	reti()	return
+
+#define	sei()	(SREG |= 0x80)
+#define	cli()	(SREG &= ~0x80)
+
+#endif
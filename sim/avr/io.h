@@ -0,0 +1,197 @@
+/*
+ * Host stand-in for avr/io.h (ATtiny85), see sim/sim.c
+ *
+ * Most registers are plain bytes. The few whose reads have side effects
+ * in hardware go through the simulator so busy waits and counters work.
+ */
+#ifndef SIM_AVR_IO_H
+#define SIM_AVR_IO_H
+
+#include <stdint.h>
+
+extern volatile uint8_t DDRB;
+extern volatile uint8_t PORTB;
+extern volatile uint8_t TCCR0A;
+extern volatile uint8_t TCCR0B;
+extern volatile uint8_t OCR0A;
+extern volatile uint8_t OCR0B;
+extern volatile uint8_t TCCR1;
+extern volatile uint8_t OCR1A;
+extern volatile uint8_t OCR1B;
+extern volatile uint8_t OCR1C;
+extern volatile uint8_t GTCCR;
+extern volatile uint8_t TIMSK;
+extern volatile uint8_t CLKPR;
+extern volatile uint8_t MCUCR;
+extern volatile uint8_t MCUSR;
+extern volatile uint8_t WDTCR;
+extern volatile uint8_t GIMSK;
+extern volatile uint8_t PCMSK;
+extern volatile uint8_t ADMUX;
+extern volatile uint8_t ADCSRB;
+extern volatile uint8_t ADCL;
+extern volatile uint8_t ADCH;
+extern volatile uint8_t DIDR0;
+extern volatile uint8_t ACSR;
+extern volatile uint8_t EEDR;
+extern volatile uint16_t EEAR;
+extern volatile uint8_t PRR;
+extern volatile uint8_t USICR;
+extern volatile uint8_t USISR;
+extern volatile uint8_t USIDR;
+extern volatile uint8_t USIBR;
+extern volatile uint8_t GPIOR0;
+extern volatile uint8_t GPIOR1;
+extern volatile uint8_t GPIOR2;
+extern volatile uint8_t SREG;
+
+volatile uint8_t *sim_adcsra(void);
+volatile uint8_t *sim_pllcsr(void);
+volatile uint8_t *sim_tcnt0(void);
+volatile uint8_t *sim_tcnt1(void);
+volatile uint8_t *sim_eecr(void);
+volatile uint8_t *sim_pinb(void);
+volatile uint8_t *sim_tifr(void);
+volatile uint8_t *sim_gifr(void);
+#define	ADCSRA	(*sim_adcsra())
+#define	EECR	(*sim_eecr())
+#define	PLLCSR	(*sim_pllcsr())
+#define	TCNT0	(*sim_tcnt0())
+#define	TCNT1	(*sim_tcnt1())
+#define	PINB	(*sim_pinb())
+#define	TIFR	(*sim_tifr())
+#define	GIFR	(*sim_gifr())
+
+// interrupt vectors, in priority order
+#define	INT0_vect		sim_vect_int0
+#define	PCINT0_vect		sim_vect_pcint0
+#define	TIMER1_COMPA_vect	sim_vect_timer1_compa
+#define	TIMER1_OVF_vect		sim_vect_timer1_ovf
+#define	TIMER0_OVF_vect		sim_vect_timer0_ovf
+#define	EE_RDY_vect		sim_vect_ee_rdy
+#define	ANA_COMP_vect		sim_vect_ana_comp
+#define	ADC_vect		sim_vect_adc
+#define	TIMER1_COMPB_vect	sim_vect_timer1_compb
+#define	TIMER0_COMPA_vect	sim_vect_timer0_compa
+#define	TIMER0_COMPB_vect	sim_vect_timer0_compb
+#define	WDT_vect		sim_vect_wdt
+#define	USI_START_vect		sim_vect_usi_start
+#define	USI_OVF_vect		sim_vect_usi_ovf
+
+#define	REFS1	7
+#define	REFS0	6
+#define	ADLAR	5
+#define	REFS2	4
+#define	ADEN	7
+#define	ADSC	6
+#define	ADATE	5
+#define	ADIF	4
+#define	ADIE	3
+#define	ADPS2	2
+#define	ADPS1	1
+#define	ADPS0	0
+#define	ADTS2	2
+#define	ADTS1	1
+#define	ADTS0	0
+#define	DDB5	5
+#define	DDB4	4
+#define	DDB3	3
+#define	DDB2	2
+#define	DDB1	1
+#define	DDB0	0
+#define	PB5	5
+#define	PB4	4
+#define	PB3	3
+#define	PB2	2
+#define	PB1	1
+#define	PB0	0
+#define	PINB2	2
+#define	COM0A1	7
+#define	COM0A0	6
+#define	COM0B1	5
+#define	COM0B0	4
+#define	WGM01	1
+#define	WGM00	0
+#define	WGM02	3
+#define	CS02	2
+#define	CS01	1
+#define	CS00	0
+#define	CTC1	7
+#define	PWM1A	6
+#define	COM1A1	5
+#define	COM1A0	4
+#define	CS13	3
+#define	CS12	2
+#define	CS11	1
+#define	CS10	0
+#define	TSM	7
+#define	PWM1B	6
+#define	COM1B1	5
+#define	COM1B0	4
+#define	PSR1	1
+#define	PSR0	0
+#define	OCIE1A	6
+#define	OCIE1B	5
+#define	OCIE0A	4
+#define	OCIE0B	3
+#define	TOIE1	2
+#define	TOIE0	1
+#define	OCF1A	6
+#define	OCF1B	5
+#define	OCF0A	4
+#define	OCF0B	3
+#define	TOV1	2
+#define	TOV0	1
+#define	LSM	7
+#define	PCKE	2
+#define	PLLE	1
+#define	PLOCK	0
+#define	CLKPCE	7
+#define	CLKPS3	3
+#define	CLKPS2	2
+#define	CLKPS1	1
+#define	CLKPS0	0
+#define	BODS	7
+#define	PUD	6
+#define	SE	5
+#define	SM1	4
+#define	SM0	3
+#define	BODSE	2
+#define	ISC01	1
+#define	ISC00	0
+#define	INT0	6
+#define	PCIE	5
+#define	INTF0	6
+#define	PCIF	5
+#define	WDIF	7
+#define	WDIE	6
+#define	WDP3	5
+#define	WDCE	4
+#define	WDE	3
+#define	WDP2	2
+#define	WDP1	1
+#define	WDP0	0
+#define	WDRF	3
+#define	BORF	2
+#define	EXTRF	1
+#define	PORF	0
+#define	EEPM1	5
+#define	EEPM0	4
+#define	EERIE	3
+#define	EEMPE	2
+#define	EEPE	1
+#define	EERE	0
+#define	PRTIM1	3
+#define	PRTIM0	2
+#define	PRUSI	1
+#define	PRADC	0
+#define	ADC0D	5
+#define	ADC2D	4
+#define	ADC3D	3
+#define	ADC1D	2
+
+#define	E2END	511
+#define	RAMEND	0x25F
+#define	_BV(b)	(1 << (b))
+
+#endif
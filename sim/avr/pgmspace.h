@@ -0,0 +1,16 @@
+/*
+ * Host stand-in for avr/pgmspace.h, flash is ordinary memory
+ */
+#ifndef SIM_AVR_PGMSPACE_H
+#define SIM_AVR_PGMSPACE_H
+
+#include <stdint.h>
+
+#define	PROGMEM
+#define	PSTR(s)	(s)
+#define	pgm_read_byte(p)	(*(const uint8_t *)(p))
+#define	pgm_read_word(p)	(*(const uint16_t *)(p))
+#define	pgm_read_dword(p)	(*(const uint32_t *)(p))
+#define	pgm_read_ptr(p)		(*(void * const *)(p))
+
+#endif
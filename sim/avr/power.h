@@ -0,0 +1,33 @@
+/*
+ * Host stand-in for avr/power.h
+ */
+#ifndef SIM_AVR_POWER_H
+#define SIM_AVR_POWER_H
+
+#include <avr/io.h>
+
+typedef enum {
+	clock_div_1 = 0,
+	clock_div_2,
+	clock_div_4,
+	clock_div_8,
+	clock_div_16,
+	clock_div_32,
+	clock_div_64,
+	clock_div_128,
+	clock_div_256
+} clock_div_t;
+
+#define	clock_prescale_set(div)	(CLKPR = (div) & 0x0f)
+#define	clock_prescale_get()	((clock_div_t)(CLKPR & 0x0f))
+
+#define	power_adc_disable()	(PRR |= (1 << PRADC))
+#define	power_adc_enable()	(PRR &= ~(1 << PRADC))
+#define	power_usi_disable()	(PRR |= (1 << PRUSI))
+#define	power_usi_enable()	(PRR &= ~(1 << PRUSI))
+#define	power_timer0_disable()	(PRR |= (1 << PRTIM0))
+#define	power_timer0_enable()	(PRR &= ~(1 << PRTIM0))
+#define	power_timer1_disable()	(PRR |= (1 << PRTIM1))
+#define	power_timer1_enable()	(PRR &= ~(1 << PRTIM1))
+
+#endif
@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for avr/sleep.h
+ *
+ * sleep_cpu() is where simulated time passes: it runs the hardware up to
+ * the next interrupt and calls the ISR.
+ */
+#ifndef SIM_AVR_SLEEP_H
+#define SIM_AVR_SLEEP_H
+
+#include <avr/io.h>
+
+#define	SLEEP_MODE_IDLE		(0 << SM0)
+#define	SLEEP_MODE_ADC		(1 << SM0)
+#define	SLEEP_MODE_PWR_DOWN	(2 << SM0)
+
+void sim_sleep(void);
+
+#define	set_sleep_mode(mode)	(MCUCR = (MCUCR & ~(3 << SM0)) | (mode))
+#define	sleep_enable()		(MCUCR |= (1 << SE))
+#define	sleep_disable()		(MCUCR &= ~(1 << SE))
+#define	sleep_cpu()		sim_sleep()
+#define	sleep_mode()		sim_sleep()
+#define	sleep_bod_disable()
+
+#endif
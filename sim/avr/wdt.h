@@ -0,0 +1,24 @@
+/*
+ * Host stand-in for avr/wdt.h, the watchdog never fires
+ */
+#ifndef SIM_AVR_WDT_H
+#define SIM_AVR_WDT_H
+
+#define	WDTO_15MS	0
+#define	WDTO_30MS	1
+#define	WDTO_60MS	2
+#define	WDTO_120MS	3
+#define	WDTO_250MS	4
+#define	WDTO_500MS	5
+#define	WDTO_1S		6
+#define	WDTO_2S		7
+#define	WDTO_4S		8
+#define	WDTO_8S		9
+
+void sim_wdt_reset(void);
+#define	wdt_reset()
+#define	wdt_disable()
+// a reset never comes back, stop the simulation
+#define	wdt_enable(timeout)	sim_wdt_reset()
+
+#endif
@@ -0,0 +1,268 @@
+/*
+ * Copyright 2023 Roger Feese
+ */
+
+/******************************************************************
+ * Sequence benchmark on the simulated ATtiny85
+ *
+ * Builds leah_sign.c against the host HAL in this directory (make bench)
+ * and runs every sequence through run_sequence() for a while, then times
+ * button presses against it. The stream sequence gets a frame over the
+ * serial line every BENCH_STREAM_MS meanwhile. For each sequence it
+ * reports:
+ *
+ *   fps       frames per simulated second actually run
+ *   step ns   host time per frame, average and worst
+ *   T0/T1/ADC interrupts per simulated second
+ *   isr%*     share of the cpu's cycles the interrupts take
+ *   cyc/fr    cpu cycles from one frame to the next at the sequence's
+ *             clock, what the frame, the main loop and the interrupts
+ *             share
+ *   isr cyc*  interrupt cycles out of those
+ *   awake%*   share of the time the cpu is out of idle sleep: the
+ *             interrupts, plus BENCH_WAKE_CYCLES for each wake,
+ *             BENCH_PASS_CYCLES for each main loop pass (one a milli)
+ *             and BENCH_FRAME_CYCLES for each frame
+ *   mA*       the cpu's supply current at 5 V from awake%, with the
+ *             datasheet's typical active and idle currents at the
+ *             sequence's clock; the ADC, the PLL and the leds come on
+ *             top
+ *   btn ms    release to run_sequence() returning, average and worst
+ *   drops     mic blocks the ADC interrupt had to drop because the main
+ *             loop hadn't taken the last one yet (for the stream, frames
+ *             sent but not shown as sent)
+ *   late%     PB3 edge interrupts that had to wait for another interrupt
+ *             or a cli section in the main loop
+ *   wait us   the longest such wait, which is the edge jitter
+ *   bright    timer1 overflows that ran after their period's compare and
+ *             left PB3 on for the whole period anyway
+ *   miss      BCM compares written too late for their slot, each a frame
+ *             that shows the wrong bits
+ *
+ * Rates and latencies are exact for the firmware's logic. The columns
+ * marked * are not measured: they are the assumed lengths in
+ * bench_isr_cycles times the measured rates, plus the time the stream
+ * receiver really spends polling, so a change to an ISR body only moves
+ * them once its entry there is updated. There is no AVR compiler in the
+ * host build to count them from; a PROFILE build times the real ones on
+ * the chip (prof_isrs), and the edge waits come from the same lengths.
+ * Main loop code has no cycle count on the host either: step ns ranks
+ * changes against each other but is no AVR figure, the host is much
+ * faster and has a multiplier and divider, and cyc/fr is the budget a
+ * frame has rather than what it costs (prof_seqs on the chip).
+ *
+ * usage: bench [run_ms [sequence]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "sim.h"
+
+#define	main	leah_main
+#include "../leah_sign.c"
+#undef	main
+
+#define	BENCH_RUN_MS	8000
+#define	BENCH_PRESSES	16
+#define	BENCH_HOLD_MS	100
+#define	BENCH_STREAM_MS	10	// 100 fps
+
+#define	BENCH_STREAM_SEQ	13
+
+// assumed main loop cycles for awake%, estimates like the ones below
+#define	BENCH_WAKE_CYCLES	12	// wake up, compare the millis, sleep
+#define	BENCH_PASS_CYCLES	250	// a pass with nothing due
+#define	BENCH_FRAME_CYCLES	500	// a sequence step and its commit
+
+// typical supply current in mA at 5 V, ATtiny85 datasheet
+#define	BENCH_ACTIVE_1MHZ	0.9
+#define	BENCH_IDLE_1MHZ		0.25
+#define	BENCH_ACTIVE_8MHZ	5.0
+#define	BENCH_IDLE_8MHZ		1.2
+
+// assumed cycles from entry to reti at -Os, for isr%, isr cyc and the
+// edge waits; estimates from the C, not from a listing
+#define	BENCH_NAKED_CYCLES	16	// sbi/cbi, maybe an sbis, and reti
+const uint16_t bench_isr_cycles[SIM_NUM_VECT] = {
+	80,	// INT0, a stream packet around its busy waits
+	50,	// T1 COMPA, BCM slots
+	30,	// T1 OVF, the pin behind a TCNT1 compare
+	100,	// T0 OVF, millis and the latch, the button every 4th
+	50,	// EE RDY, one settings byte
+	60,	// ADC, mic sample and button channel switch
+	0, 0,
+	0	// WDT, only in standby
+};
+// the longest main loop cli section, fb_commit() copying the duties
+#define	BENCH_ATOMIC_CYCLES	60
+
+const led_sequence *bench_seq;
+uint32_t bench_frames;
+uint64_t bench_step_ns, bench_step_max;
+
+uint32_t bench_sent, bench_shown;
+uint8_t bench_last_shown;
+uint8_t bench_packet[6] = { 0xff, STREAM_FRAME };
+
+// queue the next stream frame, an even step after the last one
+void bench_stream_send(){
+	bench_sent++;
+	bench_packet[2]++;
+	for(uint8_t i = 1; i < 4; i++){
+		bench_packet[2 + i] = bench_packet[2] + 64 * i;
+	}
+	sim.serial_data = bench_packet;
+	sim.serial_len = sizeof(bench_packet);
+	sim.serial_start_ns += BENCH_STREAM_MS * 1000000ull;
+	if(sim.serial_start_ns < sim.now_ns) sim.serial_start_ns = sim.now_ns;
+}
+
+// times the sequence's own step
+uint16_t bench_step(uint32_t now){
+	uint64_t t = sim_host_ns();
+	uint8_t tail = stream_tail;
+	uint16_t ms = bench_seq->step(now);
+	t = sim_host_ns() - t;
+	if(stream_tail != tail){
+		// only a frame that came through whole counts
+		uint8_t whole = 1;
+		for(uint8_t i = 1; i < 4; i++){
+			if(ss->led[i] != (uint8_t)(ss->led[0] + 64 * i)) whole = 0;
+		}
+		if(whole){
+			bench_shown++;
+			bench_last_shown = ss->led[0];
+		}
+	}
+	bench_frames++;
+	bench_step_ns += t;
+	if(t > bench_step_max) bench_step_max = t;
+	return ms;
+}
+
+void bench_reset(){
+	bench_frames = 0;
+	bench_step_ns = 0;
+	bench_step_max = 0;
+	sim.main_host_ns = 0;
+	sim.sleeps = 0;
+	for(uint8_t v = 0; v < SIM_NUM_VECT; v++){
+		sim.isr_host_ns[v] = 0;
+		sim.isr_count[v] = 0;
+		sim.isr_busy_cycles[v] = 0;
+		sim.isr_busy_ns[v] = 0;
+	}
+	sim.edge_late = 0;
+	sim.edge_wait_max_ns = 0;
+	sim.edge_bright = 0;
+	sim.t1_missed = 0;
+	sim.wake_host_ns = sim_host_ns();
+}
+
+void bench_run(uint8_t n, uint32_t run_ms){
+	bench_seq = &seq[n];
+	led_sequence s = { seq[n].program, seq[n].start, &bench_step, seq[n].hardware };
+
+	// free running
+	bench_reset();
+	uint8_t overruns = mic_overruns;
+	uint64_t start = sim.now_ns;
+	bench_sent = 0;
+	bench_shown = 0;
+	if(n == BENCH_STREAM_SEQ){
+		sim.serial_baud = STREAM_BAUD;
+		sim.serial_done = &bench_stream_send;
+		sim.serial_start_ns = sim.now_ns;
+		bench_stream_send();
+	}
+	run_sequence(&s, run_ms);
+	double secs = (sim.now_ns - start) * 1e-9;
+	uint32_t drops = (uint8_t)(mic_overruns - overruns);
+
+	uint64_t isr_ns = 0, isr_cycles = 0;
+	for(uint8_t v = 0; v < SIM_NUM_VECT; v++){
+		isr_ns += sim.isr_busy_ns[v];
+		isr_cycles += sim.isr_busy_cycles[v];
+	}
+	double isr_share = 100.0 * isr_ns / (sim.now_ns - start);
+	uint8_t fast = (clock_speed == CLOCK_8MHZ);
+	double frame_cycles = bench_frames ? (fast ? 8e6 : 1e6) * secs / bench_frames : 0;
+	double awake_cycles = isr_cycles + (double)sim.sleeps * BENCH_WAKE_CYCLES
+		+ secs * 1000 * BENCH_PASS_CYCLES + (double)bench_frames * BENCH_FRAME_CYCLES;
+	double awake = awake_cycles / ((fast ? 8e6 : 1e6) * secs);
+	if(awake > 1) awake = 1;
+	double ma = fast ? awake * BENCH_ACTIVE_8MHZ + (1 - awake) * BENCH_IDLE_8MHZ
+		: awake * BENCH_ACTIVE_1MHZ + (1 - awake) * BENCH_IDLE_1MHZ;
+	uint32_t edges = sim.isr_count[SIM_T1_OVF] + sim.isr_count[SIM_T1_COMPA];
+	double late = edges ? 100.0 * sim.edge_late / edges : 0;
+	double wait_us = sim.edge_wait_max_ns * 1e-3;
+	uint32_t bright = sim.edge_bright;
+	uint32_t missed = sim.t1_missed;
+
+	printf("%4u %7.1f %8.0f %8llu %6.0f %6.0f %6.0f %6.0f %5.1f %7.0f %7.0f %7.1f %5.2f",
+		n + 1, bench_frames / secs,
+		bench_frames ? (double)bench_step_ns / bench_frames : 0.0,
+		(unsigned long long)bench_step_max,
+		sim.isr_count[SIM_T0_OVF] / secs,
+		sim.isr_count[SIM_T1_OVF] / secs,
+		sim.isr_count[SIM_T1_COMPA] / secs,
+		sim.isr_count[SIM_ADC] / secs, isr_share, frame_cycles,
+		bench_frames ? (double)isr_cycles / bench_frames : 0.0,
+		100 * awake, ma);
+	if(n == BENCH_STREAM_SEQ){
+		// the last one may still be on its way
+		drops = bench_sent - (bench_last_shown != bench_packet[2]) - bench_shown;
+		sim.serial_done = 0;
+	}
+
+	// button presses at spread out points of the sequence
+	double total = 0, worst = 0;
+	for(uint8_t i = 0; i < BENCH_PRESSES; i++){
+		sim.button_press_ns = sim.now_ns + (100 + 37 * i) * 1000000ull;
+		sim.button_release_ns = sim.button_press_ns + BENCH_HOLD_MS * 1000000ull;
+		if(!run_sequence(&s, 2000)){
+			printf("  no release\n");
+			return;
+		}
+		double ms = (sim.now_ns - sim.button_release_ns) * 1e-6;
+		total += ms;
+		if(ms > worst) worst = ms;
+	}
+	printf(" %6.1f %6.1f %5lu %5.1f %7.1f %6lu %5lu\n", total / BENCH_PRESSES, worst, (unsigned long)drops, late, wait_us,
+		(unsigned long)bright, (unsigned long)missed);
+}
+
+int main(int argc, char **argv){
+	uint32_t run_ms = (argc > 1) ? atoi(argv[1]) : BENCH_RUN_MS;
+	int only = (argc > 2) ? atoi(argv[2]) : 0;
+
+	// a quiet room with someone talking
+	srand(1);
+	sim.mic_hz[0] = 220;
+	sim.mic_amp[0] = 60;
+	sim.mic_hz[1] = 500;
+	sim.mic_amp[1] = 30;
+	sim.mic_hz[2] = 1400;
+	sim.mic_amp[2] = 15;
+	sim.mic_noise = 6;
+
+	sim_init();
+	hardware_init();
+	// same demo order every run
+	random_state = 1;
+	// each sequence on its own, a fade would run the last one's frames too
+	transition_ms = 0;
+
+	for(uint8_t v = 0; v < SIM_NUM_VECT; v++){
+		sim.isr_cycles[v] = (sim_isr_flags(v) & SIM_ISR_NAKED) ? BENCH_NAKED_CYCLES : bench_isr_cycles[v];
+	}
+	sim.atomic_cycles = BENCH_ATOMIC_CYCLES;
+
+	printf(" seq     fps  step ns  max ns  T0/s   T1 OVF T1 CMP  ADC/s isr%%*  cyc/fr isr cyc* awake%%*   mA*  btn ms  worst drops late%% wait us bright  miss\n");
+	for(uint8_t n = 0; n < NUM_SEQ; n++){
+		if(only && (n + 1 != only)) continue;
+		bench_run(n, run_ms);
+	}
+	printf("* assumed cycles per interrupt (bench_isr_cycles) and main loop pass times the measured rates\n");
+	return 0;
+}
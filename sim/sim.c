@@ -0,0 +1,606 @@
+/*
+ * Copyright 2023 Roger Feese
+ */
+
+/******************************************************************
+ * Simulated ATtiny85 for running leah_sign.c on the host
+ *
+ * Only what the firmware uses: timer0 (in any WGM0 mode but the compare
+ * outputs) and timer1 (with the PLL), the clock prescaler, the auto
+ * triggered ADC with a button, a mic and the bandgap against a sagging
+ * supply on its inputs, EEPROM with its ready interrupt, the watchdog
+ * interrupt and INT0 on the falling edges of a serial line into PB2.
+ * Time is counted in ns and only passes in sim_sleep(), which runs the
+ * timers up to the next interrupt and calls its ISR, the way idle sleep
+ * does on the chip. The other sleep modes stop the timers, ADC noise
+ * reduction starts a conversion and power down stops the ADC as well.
+ * Code between sleeps takes no simulated time, so interrupts never
+ * preempt it and main loop work doesn't delay anything; host time spent
+ * in the ISRs and the main loop is measured instead (sim_host_ns()).
+ *
+ * The one exception is an interrupt busy waiting on timer0, like the
+ * stream receiver: each TCNT0 read in an ISR moves time on by
+ * POLL_CYCLES. The flags it passes over stay pending and run once it is
+ * done, in vector order; a timer0 overflow it reads in TIFR is taken as
+ * serviced, and INT0 edges before a GIFR write are cleared.
+ *
+ * To see what the interrupts do to the PB3 edges, each vector can be
+ * given a length in cycles (sim.isr_cycles), and every ATOMIC_BLOCK in
+ * the main loop one length (sim.atomic_cycles), counted from the end of
+ * the interrupts that woke it. A blocking interrupt or a cli section
+ * then holds off the ones after it for that long and a NOBLOCK one only
+ * for its entry. Everything that comes up meanwhile is pending together
+ * and runs in vector order, each with the time it really starts, so a
+ * timer1 overflow held off past its compare A runs after it, as on the
+ * chip. Timer1 interrupts count how long they had to wait, and
+ * sim.edge_bright the overflows that still set PB3 when they did.
+ */
+
+#include <avr/io.h>
+#include <avr/eeprom.h>
+#include <avr/interrupt.h>
+#include <avr/sleep.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+#include "sim.h"
+
+volatile uint8_t DDRB, PORTB;
+volatile uint8_t TCCR0A, TCCR0B, OCR0A, OCR0B;
+volatile uint8_t TCCR1, OCR1A, OCR1B, OCR1C, GTCCR;
+volatile uint8_t TIMSK, CLKPR, MCUCR, MCUSR, WDTCR;
+volatile uint8_t GIMSK, PCMSK;
+volatile uint8_t ADMUX, ADCSRB, ADCL, ADCH, DIDR0, ACSR;
+volatile uint8_t EEDR;
+volatile uint16_t EEAR;
+volatile uint8_t PRR, USICR, USISR, USIDR, USIBR;
+volatile uint8_t GPIOR0, GPIOR1, GPIOR2, SREG;
+
+static volatile uint8_t reg_adcsra, reg_pllcsr, reg_tcnt0, reg_tcnt1, reg_eecr, reg_pinb, reg_tifr, reg_gifr;
+
+sim_stats sim;
+
+/**
+ * Interrupt vectors
+ *
+ * Weak, so vectors the firmware doesn't define are simply absent.
+ */
+#define	VECT(name)	void name(void) __attribute__((weak));
+VECT(sim_vect_int0) VECT(sim_vect_pcint0) VECT(sim_vect_timer1_compa)
+VECT(sim_vect_timer1_ovf) VECT(sim_vect_timer0_ovf) VECT(sim_vect_ee_rdy)
+VECT(sim_vect_ana_comp) VECT(sim_vect_adc) VECT(sim_vect_timer1_compb)
+VECT(sim_vect_timer0_compa) VECT(sim_vect_timer0_compb) VECT(sim_vect_wdt)
+VECT(sim_vect_usi_start) VECT(sim_vect_usi_ovf)
+
+const char *sim_vect_names[SIM_NUM_VECT] = {
+	"INT0", "T1 COMPA", "T1 OVF", "T0 OVF", "EE RDY", "ADC", "T0 COMPA", "T0 COMPB", "WDT"
+};
+
+static void (*const vectors[SIM_NUM_VECT])(void) = {
+	sim_vect_int0, sim_vect_timer1_compa, sim_vect_timer1_ovf, sim_vect_timer0_ovf,
+	sim_vect_ee_rdy, sim_vect_adc, sim_vect_timer0_compa, sim_vect_timer0_compb,
+	sim_vect_wdt
+};
+
+// ISR attributes, see avr/interrupt.h
+#define	FLAGS(name)	extern const uint8_t name##_sim_flags __attribute__((weak));
+FLAGS(INT0_vect) FLAGS(TIMER1_COMPA_vect) FLAGS(TIMER1_OVF_vect) FLAGS(TIMER0_OVF_vect)
+FLAGS(EE_RDY_vect) FLAGS(ADC_vect) FLAGS(TIMER0_COMPA_vect) FLAGS(TIMER0_COMPB_vect)
+FLAGS(WDT_vect)
+
+static const uint8_t *const vector_flags[SIM_NUM_VECT] = {
+	&INT0_vect_sim_flags, &TIMER1_COMPA_vect_sim_flags, &TIMER1_OVF_vect_sim_flags, &TIMER0_OVF_vect_sim_flags,
+	&EE_RDY_vect_sim_flags, &ADC_vect_sim_flags, &TIMER0_COMPA_vect_sim_flags,
+	&TIMER0_COMPB_vect_sim_flags, &WDT_vect_sim_flags
+};
+
+uint8_t sim_isr_flags(uint8_t v){
+	return vector_flags[v] ? *vector_flags[v] : 0;
+}
+
+uint64_t sim_host_ns(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/**
+ * Clocks
+ */
+static uint64_t cpu_ns(){
+	// 8 MHz RC through the CLKPR prescaler
+	return 125ull << (CLKPR & 0x0f);
+}
+
+static uint64_t timer0_tick_ns(){
+	static const uint16_t prescale[8] = { 0, 1, 8, 64, 256, 1024, 0, 0 };
+	uint16_t p = prescale[TCCR0B & 7];
+	return p ? cpu_ns() * p : 0;
+}
+
+static uint8_t timer0_wgm(){
+	return (TCCR0A & 3) | (((TCCR0B >> WGM02) & 1) << 2);
+}
+
+// ticks from one overflow to the next: up to TOP and over (normal, fast
+// PWM, CTC) or up and back down to BOTTOM (phase correct)
+static uint16_t timer0_period(){
+	uint16_t period;
+	switch(timer0_wgm()){
+	case 1: period = 510; break;
+	case 5: period = 2 * OCR0A; break;
+	case 2: case 7: period = OCR0A + 1; break;
+	default: period = 256;
+	}
+	return period ? period : 1;
+}
+
+static uint8_t timer0_count(uint64_t ticks){
+	uint16_t period = timer0_period();
+	uint16_t pos = ticks % period;
+	uint8_t wgm = timer0_wgm();
+	return (((wgm == 1) || (wgm == 5)) && (pos > period / 2)) ? period - pos : pos;
+}
+
+// CTC clears at OCR0A and only overflows if that is MAX
+static uint8_t timer0_overflows(){
+	return (timer0_wgm() != 2) || (OCR0A == 255);
+}
+
+static uint64_t timer1_tick_ns(){
+	uint8_t cs = TCCR1 & 15;
+	if(!cs) return 0;
+	// PCK is 64 MHz, 15.625 ns, kept in 1/8 ns below
+	uint64_t tick = (reg_pllcsr & (1 << PCKE)) ? 125 : cpu_ns() * 8;
+	return (tick << (cs - 1)) / 8;
+}
+
+// the watchdog's 128 kHz oscillator, 2K cycles and up
+static uint64_t wdt_period_ns(){
+	if(!(WDTCR & (1 << WDIE))) return 0;
+	uint8_t wdp = (WDTCR & 7) | ((WDTCR >> WDP3) & 1) << 3;
+	return 16000000ull << wdp;
+}
+
+static uint64_t adc_clock_ns(){
+	uint8_t ps = reg_adcsra & 7;
+	return cpu_ns() << (ps ? ps : 1);
+}
+
+// next time after from that a counter with this period reaches offset
+static uint64_t next_time(uint64_t from, uint64_t period, uint64_t offset){
+	uint64_t t = from - from % period + offset;
+	return (t > from) ? t : t + period;
+}
+
+static void serial_poll(void);
+
+/**
+ * Interrupts busy waiting, see the top
+ */
+#define	POLL_CYCLES	4	// in, compare and branch
+
+static uint8_t isr_running;
+static uint8_t t0_pending;		// overflowed during a busy wait
+static uint64_t isr_late_ns;		// how long the running one waited to start
+static uint64_t scan_ns;		// timer1 and watchdog events are raised from here on
+static uint64_t int0_after;		// INTF0 last cleared
+static uint64_t main_ns;		// the main loop goes on after the last interrupt
+static uint64_t atomic_from, atomic_to;	// its latest cli section
+static uint64_t ocr1a_armed_ns;		// OCR1A last written by compare A
+
+static void isr_poll(){
+	uint64_t before = sim.now_ns;
+	sim.now_ns += POLL_CYCLES * cpu_ns();
+	uint64_t t0 = timer0_tick_ns();
+	if(t0 && timer0_overflows()){
+		uint64_t period = timer0_period() * t0;
+		if(before / period != sim.now_ns / period) t0_pending = 1;
+	}
+	serial_poll();
+}
+
+/**
+ * Serial input on PB2
+ */
+// bit k of the queued bytes, 8N1 LSB first, idle high after them
+static uint8_t serial_bit(uint64_t k){
+	if(k >= 10ull * sim.serial_len) return 1;
+	uint8_t b = k % 10;
+	if(b == 0) return 0;
+	if(b == 9) return 1;
+	return (sim.serial_data[k / 10] >> (b - 1)) & 1;
+}
+
+static uint64_t serial_bit_ns(uint64_t k){
+	return sim.serial_start_ns + (k * 1000000000ull + sim.serial_baud - 1) / sim.serial_baud;
+}
+
+static uint64_t serial_bit_now(){
+	return (sim.now_ns - sim.serial_start_ns) * sim.serial_baud / 1000000000ull;
+}
+
+static uint8_t serial_level(){
+	if(!sim.serial_len || (sim.now_ns < sim.serial_start_ns)) return 1;
+	return serial_bit(serial_bit_now());
+}
+
+// more once the last stop bit is out
+static void serial_poll(){
+	if(sim.serial_len && (sim.now_ns >= serial_bit_ns(10ull * sim.serial_len))){
+		sim.serial_len = 0;
+		if(sim.serial_done) sim.serial_done();
+	}
+}
+
+// next falling edge after from, UINT64_MAX if none is queued
+static uint64_t serial_next_fall(uint64_t from){
+	if(!sim.serial_len) return UINT64_MAX;
+	uint64_t k = (from < sim.serial_start_ns) ? 0 : (from - sim.serial_start_ns) * sim.serial_baud / 1000000000ull + 1;
+	for(; k < 10ull * sim.serial_len; k++){
+		if(!serial_bit(k) && ((k == 0) || serial_bit(k - 1))) return serial_bit_ns(k);
+	}
+	return UINT64_MAX;
+}
+
+/**
+ * ADC inputs
+ */
+static uint16_t adc_sample(uint8_t channel){
+	if(channel == 0){
+		// RESET pin divider, ~0.5 Vcc while the button is held
+		return sim.button_down ? 500 : 1023;
+	}
+	if(channel == 1){
+		// mic preamp biased at Vcc / 2
+		double t = sim.now_ns * 1e-9;
+		double s = 0;
+		for(int i = 0; i < SIM_MIC_TONES; i++){
+			s += sim.mic_amp[i] * sin(2 * M_PI * sim.mic_hz[i] * t);
+		}
+		s += sim.mic_noise * ((rand() & 0xff) - 128) / 128.0;
+		int v = 512 + (int)s;
+		return (v < 0) ? 0 : (v > 1023) ? 1023 : v;
+	}
+	if(channel == 12){
+		// bandgap against Vcc, which sags with the load
+		// COMnB 3 is inverted, on from the match to the end of the period
+		uint8_t oc0b = (((TCCR0A >> COM0B0) & 3) == 3) ? 255 - OCR0B : OCR0B;
+		uint8_t oc1b = (((GTCCR >> COM1B0) & 3) == 3) ? 255 - OCR1B : OCR1B;
+		double load = (OCR0A + oc0b + oc1b + OCR1A) / 1020.0;
+		double vcc = (sim.vcc ? sim.vcc : 5.0) - sim.vcc_sag * load;
+		int v = (int)(1.1 * 1024 / vcc);
+		return (v > 1023) ? 1023 : v;
+	}
+	return 0;
+}
+
+static void adc_result(){
+	uint16_t v = adc_sample(ADMUX & 0x0f);
+	if(ADMUX & (1 << ADLAR)){
+		ADCH = v >> 2;
+		ADCL = v << 6;
+	}
+	else {
+		ADCH = v >> 8;
+		ADCL = v;
+	}
+	reg_adcsra = (reg_adcsra & ~(1 << ADSC)) | (1 << ADIF);
+}
+
+static void adc_start(uint64_t at){
+	if(sim.adc_done_ns) return;
+	sim.adc_done_ns = at + 13 * adc_clock_ns();
+}
+
+/**
+ * Registers with side effects
+ */
+volatile uint8_t *sim_adcsra(){
+	if((reg_adcsra & (1 << ADEN)) && (reg_adcsra & (1 << ADSC))){
+		if(reg_adcsra & (1 << ADIE)){
+			// finishes in sim_sleep()
+			adc_start(sim.now_ns);
+		}
+		else {
+			// polled conversion, done by the time anyone looks
+			adc_result();
+		}
+	}
+	return &reg_adcsra;
+}
+
+volatile uint8_t *sim_pllcsr(){
+	// locks at once
+	if(reg_pllcsr & (1 << PLLE)) reg_pllcsr |= (1 << PLOCK);
+	return &reg_pllcsr;
+}
+
+volatile uint8_t *sim_tcnt0(){
+	if(isr_running) isr_poll();
+	uint64_t tick = timer0_tick_ns();
+	reg_tcnt0 = tick ? timer0_count(sim.now_ns / tick) : 0;
+	return &reg_tcnt0;
+}
+
+// timer1 always starts its periods at 0 here, writes are lost
+volatile uint8_t *sim_tcnt1(){
+	uint64_t tick = timer1_tick_ns();
+	// an ISR sees the count from when it really runs, after its entry
+	uint64_t t = sim.now_ns + (isr_running ? isr_late_ns + SIM_ENTRY_CYCLES * cpu_ns() : 0);
+	reg_tcnt1 = tick ? (t / tick) % (OCR1C + 1) : 0;
+	return &reg_tcnt1;
+}
+
+volatile uint8_t *sim_tifr(){
+	// only TOV0, and only ever pending in a busy wait; writes are lost
+	reg_tifr = t0_pending ? (1 << TOV0) : 0;
+	if(isr_running) t0_pending = 0;
+	return &reg_tifr;
+}
+
+// only ever written to clear INTF0
+volatile uint8_t *sim_gifr(){
+	int0_after = sim.now_ns;
+	reg_gifr = 0;
+	return &reg_gifr;
+}
+
+volatile uint8_t *sim_pinb(){
+	reg_pinb = (reg_pinb & ~(1 << PINB2)) | (serial_level() << PINB2);
+	return &reg_pinb;
+}
+
+/**
+ * EEPROM
+ */
+extern uint8_t __start_sim_eeprom[], __stop_sim_eeprom[];
+uint8_t sim_eeprom[512];
+
+uint8_t *sim_eeprom_addr(const void *p){
+	return &sim_eeprom[((const uint8_t *)p - __start_sim_eeprom) & 511];
+}
+
+static uint16_t ee_write_addr;
+static uint8_t ee_write_data;
+
+volatile uint8_t *sim_eecr(){
+	if((reg_eecr & (1 << EEPE)) && !sim.ee_done_ns){
+		// EEAR holds an EEMEM pointer cut to 16 bits, like on the chip
+		ee_write_addr = (EEAR - (uint16_t)(uintptr_t)__start_sim_eeprom) & 511;
+		ee_write_data = EEDR;
+		sim.ee_done_ns = sim.now_ns + 3400000;
+		sim.ee_writes++;
+	}
+	return &reg_eecr;
+}
+
+void sim_wdt_reset(){
+	fprintf(stderr, "sim: watchdog reset at %.3f s\n", sim.now_ns * 1e-9);
+	if(sim.on_reset) sim.on_reset();
+	exit(1);
+}
+
+/**
+ * Running
+ */
+void sim_init(){
+	// EEMEM variables are the .eep image
+	for(uint8_t *p = __start_sim_eeprom; p < __stop_sim_eeprom; p++){
+		sim_eeprom[p - __start_sim_eeprom] = *p;
+	}
+	CLKPR = 3;
+	OCR1C = 255;
+}
+
+// first time from t that interrupts are on
+static uint64_t cpu_free(uint64_t t){
+	if(sim.masked_ns > t) t = sim.masked_ns;
+	if((t >= atomic_from) && (t < atomic_to)) t = atomic_to;
+	return t;
+}
+
+static void dispatch(uint8_t v, uint64_t event_ns){
+	if(!vectors[v]) return;
+
+	// queue behind whatever has interrupts off
+	uint64_t start = cpu_free(sim.now_ns);
+	isr_late_ns = start - sim.now_ns;
+	if((v == SIM_T1_COMPA) || (v == SIM_T1_OVF)){
+		uint64_t wait = start - event_ns;
+		if(wait) sim.edge_late++;
+		if(wait > sim.edge_wait_max_ns) sim.edge_wait_max_ns = wait;
+	}
+
+	uint64_t t = sim_host_ns();
+	uint64_t before = sim.now_ns;
+	uint8_t ocr1a = OCR1A;
+	isr_running = 1;
+	vectors[v]();
+	isr_running = 0;
+	sim.isr_host_ns[v] += sim_host_ns() - t;
+	sim.isr_count[v]++;
+
+	// where compare A ends the pulse, an overflow that starts after the
+	// match of the period it runs in has missed it, and PB3 set now stays
+	// on until the next one
+	if((v == SIM_T1_OVF) && (TCCR1 & (1 << PWM1A)) && (PORTB & (1 << PB3))){
+		uint64_t tick = timer1_tick_ns();
+		if(tick && (((start + SIM_ENTRY_CYCLES * cpu_ns()) / tick) % (OCR1C + 1) >= OCR1A)) sim.edge_bright++;
+	}
+
+	uint64_t polled = sim.now_ns - before;
+	uint64_t end = start + sim.isr_cycles[v] * cpu_ns() + polled;
+	// compare A setting up its next match (BCM) writes it at its end, and
+	// it only matches once the count gets there after that; counted as
+	// missed if it was meant for an earlier one
+	uint64_t tick = timer1_tick_ns();
+	if((v == SIM_T1_COMPA) && (OCR1A != ocr1a) && tick && (OCR1A <= OCR1C)){
+		if(next_time(start, (OCR1C + 1) * tick, OCR1A * tick) <= end) sim.t1_missed++;
+		ocr1a_armed_ns = end;
+	}
+	sim.isr_busy_cycles[v] += sim.isr_cycles[v] + polled / cpu_ns();
+	sim.isr_busy_ns[v] += sim.isr_cycles[v] * cpu_ns() + polled;
+	if(sim_isr_flags(v) & SIM_ISR_NOBLOCK){
+		sim.masked_ns = start + (SIM_ENTRY_CYCLES + 2) * cpu_ns();
+	}
+	else if(sim.isr_cycles[v] || polled){
+		sim.masked_ns = start + sim.isr_cycles[v] * cpu_ns() + polled;
+	}
+	main_ns = end;
+}
+
+// main loop cli sections start once the interrupts before them are done
+void sim_atomic(){
+	if(isr_running || !sim.atomic_cycles) return;
+	atomic_from = (main_ns > sim.now_ns) ? main_ns : sim.now_ns;
+	atomic_to = atomic_from + sim.atomic_cycles * cpu_ns();
+}
+
+// run the hardware up to the next event, return the vectors it raised
+static uint8_t step(){
+	// runs as soon as the busy wait that passed it is over
+	if(t0_pending){
+		t0_pending = 0;
+		if(TIMSK & (1 << TOIE0)){
+			dispatch(SIM_T0_OVF, sim.now_ns);
+			sim_adcsra();
+			return 1;
+		}
+	}
+
+	serial_poll();
+
+	// EE_RDY is a level, it fires for as long as the EEPROM is idle
+	if((sim_eecr(), reg_eecr & (1 << EERIE)) && !(reg_eecr & (1 << EEPE))){
+		dispatch(SIM_EE_RDY, sim.now_ns);
+		sim_eecr();
+		return 1;
+	}
+
+	// only idle keeps the timers, power down stops the ADC too
+	uint8_t mode = MCUCR & (3 << SM0);
+	uint64_t t0 = 0, t1 = 0;
+	if(mode == SLEEP_MODE_IDLE){
+		t0 = timer0_tick_ns();
+		t1 = timer1_tick_ns();
+	}
+	// timer1 and the watchdog from the last scan, so flags they set while
+	// an interrupt busy waited still come up; timer0's are in t0_pending
+	uint64_t t0_ovf = (t0 && timer0_overflows()) ? next_time(sim.now_ns, timer0_period() * t0, 0) : UINT64_MAX;
+	uint64_t t1_ovf = UINT64_MAX, t1_compa = UINT64_MAX;
+	if(t1){
+		uint64_t period = (OCR1C + 1) * t1;
+		t1_ovf = next_time(scan_ns, period, 0);
+		uint64_t from = (ocr1a_armed_ns > scan_ns) ? ocr1a_armed_ns : scan_ns;
+		if(OCR1A <= OCR1C) t1_compa = next_time(from, period, OCR1A * t1);
+	}
+	uint64_t adc = (sim.adc_done_ns && (mode != SLEEP_MODE_PWR_DOWN)) ? sim.adc_done_ns : UINT64_MAX;
+	uint64_t ee = sim.ee_done_ns ? sim.ee_done_ns : UINT64_MAX;
+	uint64_t wdt = wdt_period_ns();
+	wdt = wdt ? next_time(scan_ns, wdt, 0) : UINT64_MAX;
+	// falling edge, any sleep but power down, since INTF0 was last cleared
+	uint64_t int0 = UINT64_MAX;
+	if((GIMSK & (1 << INT0)) && (((MCUCR >> ISC00) & 3) == 2) && (mode != SLEEP_MODE_PWR_DOWN)){
+		int0 = serial_next_fall((scan_ns > int0_after) ? scan_ns : int0_after);
+	}
+	// finished during a busy wait
+	if(adc < sim.now_ns) adc = sim.now_ns;
+	if(ee < sim.now_ns) ee = sim.now_ns;
+
+	uint64_t when = int0;
+	if(t1_compa < when) when = t1_compa;
+	if(t1_ovf < when) when = t1_ovf;
+	if(t0_ovf < when) when = t0_ovf;
+	if(adc < when) when = adc;
+	if(ee < when) when = ee;
+	if(wdt < when) when = wdt;
+	if(when == UINT64_MAX){
+		fprintf(stderr, "sim: sleeping with every clock stopped\n");
+		exit(1);
+	}
+	// nothing is taken while interrupts are off, what came up meanwhile
+	// is pending together and goes in vector order
+	uint64_t due = cpu_free((when > sim.now_ns) ? when : sim.now_ns);
+	sim.now_ns = due;
+	scan_ns = due;
+	sim.button_down = (due >= sim.button_press_ns) && (due < sim.button_release_ns);
+
+	uint8_t woke = 0;
+	if(int0 <= due){
+		dispatch(SIM_INT0, int0);
+		woke++;
+	}
+	if(ee <= due){
+		// EE_RDY follows on the next step
+		sim.ee_done_ns = 0;
+		sim_eeprom[ee_write_addr] = ee_write_data;
+		reg_eecr &= ~(1 << EEPE);
+	}
+	if((t1_compa <= due) && (TIMSK & (1 << OCIE1A))){
+		dispatch(SIM_T1_COMPA, t1_compa);
+		woke++;
+	}
+	if((t1_ovf <= due) && (TIMSK & (1 << TOIE1))){
+		dispatch(SIM_T1_OVF, t1_ovf);
+		woke++;
+	}
+	if(t0_ovf <= due){
+		// timer0 overflow auto triggers the ADC, on time whatever the cpu
+		// is doing
+		if((reg_adcsra & (1 << ADEN)) && (reg_adcsra & (1 << ADATE)) && ((ADCSRB & 7) == 4)){
+			adc_start(t0_ovf);
+		}
+		if(TIMSK & (1 << TOIE0)){
+			dispatch(SIM_T0_OVF, t0_ovf);
+			woke++;
+			// the tick may have started a slow mic sample
+			sim_adcsra();
+		}
+	}
+	if(adc <= due){
+		sim.adc_done_ns = 0;
+		adc_result();
+		if(reg_adcsra & (1 << ADIE)){
+			reg_adcsra &= ~(1 << ADIF);
+			dispatch(SIM_ADC, adc);
+			woke++;
+		}
+		// the ISR may have started the next one
+		sim_adcsra();
+	}
+	if(wdt <= due){
+		dispatch(SIM_WDT, wdt);
+		woke++;
+	}
+	return woke;
+}
+
+void sim_sleep(){
+	if(!(SREG & 0x80)){
+		fprintf(stderr, "sim: sleeping with interrupts off\n");
+		exit(1);
+	}
+
+	// main loop work since the last sleep
+	sim.main_host_ns += sim_host_ns() - sim.wake_host_ns;
+	sim.sleeps++;
+
+	// ADC noise reduction starts a conversion on the way in
+	if(((MCUCR & (3 << SM0)) == SLEEP_MODE_ADC) && (reg_adcsra & (1 << ADEN)) && !(reg_adcsra & (1 << ADATE))){
+		reg_adcsra |= (1 << ADSC);
+		sim_adcsra();
+	}
+
+	// masked events don't wake the cpu
+	uint64_t start = sim.now_ns;
+	while(!step()){
+		if(sim.now_ns - start > 10000000000ull){
+			fprintf(stderr, "sim: asleep for 10 s with no interrupt\n");
+			exit(1);
+		}
+	}
+
+	sim.wake_host_ns = sim_host_ns();
+}
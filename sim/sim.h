@@ -0,0 +1,83 @@
+/*
+ * Copyright 2023 Roger Feese
+ */
+
+/******************************************************************
+ * Simulated ATtiny85, see sim.c
+ */
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+// vectors sim.c can raise, in priority order
+#define	SIM_INT0	0
+#define	SIM_T1_COMPA	1
+#define	SIM_T1_OVF	2
+#define	SIM_T0_OVF	3
+#define	SIM_EE_RDY	4
+#define	SIM_ADC		5
+#define	SIM_T0_COMPA	6
+#define	SIM_T0_COMPB	7
+#define	SIM_WDT		8
+#define	SIM_NUM_VECT	9
+
+#define	SIM_MIC_TONES	4
+
+typedef struct {
+	// simulated time
+	uint64_t now_ns;
+	uint64_t adc_done_ns;		// end of the running conversion, or 0
+	uint64_t ee_done_ns;		// end of the running EEPROM write, or 0
+	uint32_t ee_writes;
+
+	// inputs
+	uint8_t button_down;
+	uint64_t button_press_ns;	// hold the button from press to release
+	uint64_t button_release_ns;
+	double mic_hz[SIM_MIC_TONES];
+	double mic_amp[SIM_MIC_TONES];	// in 10 bit ADC steps
+	double mic_noise;
+	double vcc;			// supply with the leds off, 5 V if 0
+	double vcc_sag;			// drop with all four full on
+	void (*on_reset)(void);		// called on a watchdog reset, before the sim stops
+
+	// 8N1 serial into PB2 (INT0), idle high between packets
+	uint32_t serial_baud;
+	const uint8_t *serial_data;	// bytes back to back from serial_start_ns
+	uint8_t serial_len;
+	uint64_t serial_start_ns;
+	void (*serial_done)(void);	// called once the last one is out, to queue more
+
+	// host time
+	uint64_t wake_host_ns;		// when the main loop last woke up
+	uint64_t main_host_ns;		// spent between sleeps
+	uint32_t sleeps;		// sleep_cpu() calls, one per wake
+	uint64_t isr_host_ns[SIM_NUM_VECT];
+	uint32_t isr_count[SIM_NUM_VECT];
+
+	// interrupt load and PB3 edge latency, from cycle counts the caller
+	// fills in
+	uint16_t isr_cycles[SIM_NUM_VECT];	// entry to reti, 0 costs nothing
+	uint64_t isr_busy_cycles[SIM_NUM_VECT];	// isr_cycles per call plus any busy waits
+	uint64_t isr_busy_ns[SIM_NUM_VECT];
+	uint16_t atomic_cycles;			// each ATOMIC_BLOCK in the main loop
+	uint64_t masked_ns;		// interrupts held off until then
+	uint32_t edge_late;		// T1 interrupts that waited for another one
+	uint64_t edge_wait_max_ns;
+	uint32_t edge_bright;		// T1 overflows that set PB3 after the period's compare A
+	uint32_t t1_missed;		// OCR1A written by compare A after the match it was meant for
+} sim_stats;
+
+extern sim_stats sim;
+extern const char *sim_vect_names[SIM_NUM_VECT];
+
+// interrupt response and the rjmp from the vector table
+#define	SIM_ENTRY_CYCLES	6
+
+void sim_init(void);
+uint8_t sim_isr_flags(uint8_t v);
+void sim_sleep(void);
+uint64_t sim_host_ns(void);
+
+#endif
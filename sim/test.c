@@ -0,0 +1,121 @@
+/*
+ * Copyright 2023 Roger Feese
+ */
+
+/******************************************************************
+ * Behaviour tests on the simulated ATtiny85
+ *
+ * Builds leah_sign.c against the host HAL like the bench (make test).
+ * A reset stops the simulation, so each case runs in its own process
+ * and reports through its exit status. Prints one line per case and
+ * exits non zero if any failed.
+ *
+ * usage: test
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "sim.h"
+
+#define	main	leah_main
+#include "../leah_sign.c"
+#undef	main
+
+#define	TEST_PASS	0
+#define	TEST_FAIL	2
+
+// press at 100 ms, held for hold_ms
+void test_press(uint32_t hold_ms){
+	sim.button_press_ns = sim.now_ns + 100 * 1000000ull;
+	sim.button_release_ns = sim.button_press_ns + hold_ms * 1000000ull;
+}
+
+/**
+ * A long press saves the settings and resets, whenever the button comes
+ * back up
+ */
+uint8_t long_press_gen;
+
+void long_press_reset(){
+	settings_record r;
+	eeprom_read_block(&r, &settings_log_ee[settings_slot], sizeof(r));
+	uint8_t saved = !settings_busy() && (r.gen == (uint8_t)(long_press_gen + 1)) &&
+		(r.check == settings_check(&r)) && !memcmp(&r, &settings, sizeof(r));
+	if(!saved) fprintf(stderr, "reset before the settings were saved\n");
+	_exit(saved ? TEST_PASS : TEST_FAIL);
+}
+
+uint8_t test_long_press(uint32_t hold_ms){
+	long_press_gen = settings.gen;
+	sim.on_reset = &long_press_reset;
+	test_press(hold_ms);
+	int r = run_sequence(&seq[0], 10000);
+	fprintf(stderr, "returned %d without a reset\n", r);
+	return TEST_FAIL;
+}
+
+/**
+ * Nothing fades out of a sequence that set up the hardware for itself
+ */
+const led_sequence *hardware_seq;
+uint32_t hardware_steps;
+
+uint16_t hardware_step(uint32_t now){
+	hardware_steps++;
+	return hardware_seq->step(now);
+}
+
+uint8_t test_no_fade(uint32_t n){
+	hardware_seq = &seq[n];
+	led_sequence s = { 0, seq[n].start, &hardware_step, seq[n].hardware };
+	transition_ms = 1000;
+	run_sequence(&s, 500);
+	uint32_t steps = hardware_steps;
+	run_sequence(&seq[0], 500);
+	if(hardware_steps != steps){
+		fprintf(stderr, "stepped %lu times after the next sequence started\n", (unsigned long)(hardware_steps - steps));
+		return TEST_FAIL;
+	}
+	return TEST_PASS;
+}
+
+/**
+ * Running
+ */
+typedef struct {
+	const char *name;
+	uint8_t (*run)(uint32_t arg);
+	uint32_t arg;
+} test_case;
+
+const test_case tests[] = {
+	{ "long press, 3.2 s hold", &test_long_press, 3200 },
+	{ "long press, 3.5 s hold", &test_long_press, 3500 },
+	{ "long press, 4.5 s hold", &test_long_press, 4500 },
+	{ "long press, 7 s hold", &test_long_press, 7000 },
+	{ "no fade out of seq12", &test_no_fade, 11 },
+	{ "no fade out of seq13", &test_no_fade, 12 },
+	{ "no fade out of seq14", &test_no_fade, 13 },
+};
+
+int main(){
+	uint8_t failed = 0;
+	for(uint8_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++){
+		fflush(stdout);
+		pid_t pid = fork();
+		if(pid == 0){
+			sim_init();
+			hardware_init();
+			transition_ms = 0;
+			_exit(tests[i].run(tests[i].arg));
+		}
+		int status;
+		waitpid(pid, &status, 0);
+		uint8_t pass = WIFEXITED(status) && (WEXITSTATUS(status) == TEST_PASS);
+		printf("%s  %s\n", pass ? "ok  " : "FAIL", tests[i].name);
+		failed += !pass;
+	}
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,25 @@
+/*
+ * Host stand-in for util/atomic.h
+ */
+#ifndef SIM_UTIL_ATOMIC_H
+#define SIM_UTIL_ATOMIC_H
+
+#include <avr/io.h>
+
+// holds the interrupts off for sim.atomic_cycles, see sim.c
+void sim_atomic(void);
+
+static inline uint8_t sim_atomic_enter(void){
+	sim_atomic();
+	uint8_t s = SREG;
+	SREG &= ~0x80;
+	return s;
+}
+
+#define	ATOMIC_RESTORESTATE
+#define	ATOMIC_FORCEON
+#define	ATOMIC_BLOCK(type)	for(uint8_t sim_sreg = sim_atomic_enter(), sim_once = 1; \
+					sim_once; SREG = sim_sreg, sim_once = 0)
+#define	NONATOMIC_BLOCK(type)	for(uint8_t sim_once = 1; sim_once; sim_once = 0)
+
+#endif
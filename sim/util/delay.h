@@ -0,0 +1,10 @@
+/*
+ * Host stand-in for util/delay.h, delays take no simulated time
+ */
+#ifndef SIM_UTIL_DELAY_H
+#define SIM_UTIL_DELAY_H
+
+#define	_delay_us(us)
+#define	_delay_ms(ms)
+
+#endif
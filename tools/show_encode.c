@@ -0,0 +1,186 @@
+/*
+ * Copyright 2023 Roger Feese
+ */
+
+/******************************************************************
+ * Recorded show encoder
+ *
+ * Turns CSV frame dumps (four levels 0-255 per line, CH1-CH4) into the
+ * PROGMEM arrays the firmware plays with show_step(), see "Recorded
+ * shows" in leah_sign.c for the format. Lines that don't start with a
+ * number (a header, # comments) are skipped. Each file becomes
+ * show_<name>[] after its base name.
+ *
+ * Every frame is first checked against the current deltas, and frames
+ * that match only extend a run. Where one doesn't, the channels that
+ * changed slope get new deltas, packed two to a byte when they are
+ * small, so a straight fade costs a record and a run however long it is
+ * and a hold a byte per 127 frames.
+ *
+ * usage: show_encode frame_ms file.csv... > shows.h
+ */
+
+#include <ctype.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// keep in step with leah_sign.c
+#define	SHOW_END	0x00
+#define	SHOW_RUN_MAX	0x7f
+#define	SHOW_DELTA	0x80
+#define	SHOW_DELTA4	0x90
+#define	SHOW_LEVEL	0xa0
+
+#define	MAX_FRAMES	100000
+
+uint8_t frames[MAX_FRAMES][4];
+uint32_t num_frames;
+
+uint8_t out[5 * MAX_FRAMES + 8];
+uint32_t out_len;
+
+// read a CSV of frames, 0 on error
+int read_csv(const char *path){
+	FILE *f = fopen(path, "r");
+	if(!f){
+		perror(path);
+		return 0;
+	}
+	char line[256];
+	uint32_t n = 0;
+	num_frames = 0;
+	while(fgets(line, sizeof(line), f)){
+		n++;
+		char *p = line;
+		while(isspace((unsigned char)*p)) p++;
+		if(!isdigit((unsigned char)*p)) continue;
+
+		if(num_frames == MAX_FRAMES){
+			fprintf(stderr, "%s:%u: more than %u frames\n", path, n, MAX_FRAMES);
+			fclose(f);
+			return 0;
+		}
+		for(uint8_t i = 0; i < 4; i++){
+			char *end;
+			long v = strtol(p, &end, 10);
+			if((end == p) || (v < 0) || (v > 255)){
+				fprintf(stderr, "%s:%u: want four levels 0-255\n", path, n);
+				fclose(f);
+				return 0;
+			}
+			frames[num_frames][i] = v;
+			p = end;
+			while(isspace((unsigned char)*p) || (*p == ',') || (*p == ';')) p++;
+		}
+		num_frames++;
+	}
+	fclose(f);
+	if(num_frames == 0){
+		fprintf(stderr, "%s: no frames\n", path);
+		return 0;
+	}
+	return 1;
+}
+
+void encode(uint8_t frame_ms){
+	uint8_t level[4];
+	int8_t delta[4] = { 0, 0, 0, 0 };
+	uint8_t run = 0;
+
+	out_len = 0;
+	out[out_len++] = frame_ms;
+
+	// the first frame sets every channel, so the show starts over clean
+	out[out_len++] = SHOW_LEVEL | 0x0f;
+	for(uint8_t i = 0; i < 4; i++){
+		level[i] = frames[0][i];
+		out[out_len++] = level[i];
+	}
+
+	for(uint32_t f = 1; f < num_frames; f++){
+		// wraps at 8 bits like the firmware
+		int8_t want[4];
+		uint8_t mask = 0, small = 1;
+		for(uint8_t i = 0; i < 4; i++){
+			want[i] = (int8_t)(uint8_t)(frames[f][i] - level[i]);
+			if(want[i] != delta[i]){
+				mask |= (1 << i);
+				if((want[i] < -8) || (want[i] > 7)) small = 0;
+			}
+			level[i] = frames[f][i];
+		}
+
+		if(!mask){
+			if(++run == SHOW_RUN_MAX){
+				out[out_len++] = run;
+				run = 0;
+			}
+			continue;
+		}
+		if(run){
+			out[out_len++] = run;
+			run = 0;
+		}
+
+		out[out_len++] = (small ? SHOW_DELTA4 : SHOW_DELTA) | mask;
+		uint8_t half = 0;
+		for(uint8_t i = 0; i < 4; i++){
+			if(!(mask & (1 << i))) continue;
+			delta[i] = want[i];
+			if(!small){
+				out[out_len++] = (uint8_t)want[i];
+			}
+			else if(!half){
+				out[out_len++] = want[i] & 0x0f;
+				half = 1;
+			}
+			else {
+				out[out_len - 1] |= (want[i] & 0x0f) << 4;
+				half = 0;
+			}
+		}
+	}
+	if(run) out[out_len++] = run;
+	out[out_len++] = SHOW_END;
+}
+
+int main(int argc, char **argv){
+	if(argc < 3){
+		fprintf(stderr, "usage: show_encode frame_ms file.csv... > shows.h\n");
+		return 1;
+	}
+	int frame_ms = atoi(argv[1]);
+	if((frame_ms < 1) || (frame_ms > 255)){
+		fprintf(stderr, "show_encode: frame_ms is 1-255\n");
+		return 1;
+	}
+
+	printf("// generated by tools/show_encode, don't edit\n");
+	for(int a = 2; a < argc; a++){
+		if(!read_csv(argv[a])) return 1;
+		encode(frame_ms);
+
+		// show_ and the base name without its extension, as an identifier
+		char path[256], name[256];
+		snprintf(path, sizeof(path), "%s", argv[a]);
+		snprintf(name, sizeof(name), "%s", basename(path));
+		char *dot = strrchr(name, '.');
+		if(dot) *dot = 0;
+		for(char *p = name; *p; p++){
+			if(!isalnum((unsigned char)*p)) *p = '_';
+		}
+
+		double secs = num_frames * frame_ms * 1e-3;
+		printf("\n// %s: %u frames of %d ms, %.1f s in %u bytes\n", argv[a], num_frames, frame_ms, secs, out_len);
+		printf("const uint8_t show_%s[] PROGMEM = {", name);
+		for(uint32_t i = 0; i < out_len; i++){
+			printf("%s0x%02x%s", (i % 12) ? " " : "\n\t", out[i], (i + 1 < out_len) ? "," : "");
+		}
+		printf("\n};\n");
+		fprintf(stderr, "%s: %u frames, %u bytes\n", argv[a], num_frames, out_len);
+	}
+	return 0;
+}